@@ -116,6 +116,7 @@ if (maek.OS === 'windows') {
 const shared_objs = [
 	maek.CPP('data_path.cpp'),
 	maek.CPP('gl_compile_program.cpp'),
+	maek.CPP('gl_state.cpp'),
 	maek.CPP('GL.cpp')
 ];
 
@@ -123,17 +124,42 @@ const shared_objs = [
 const build_assets_objs = [
     maek.CPP('build_assets.cpp'),
     maek.CPP('asset_pipeline.cpp'),  // Only used at build time
+    maek.CPP('bitplanes.cpp'),
+    maek.CPP('cpu_features.cpp'),
     maek.CPP('load_save_png.cpp', 'objs/build_load_save_png'),  // Separate object file for build tool
     ...shared_objs  // Reuse shared objects
 ];
 const build_assets_exe = maek.LINK(build_assets_objs, 'build_assets');
 
+// Build the level compiler (levels/*.txt or *.png -> dist/*.levl; run like build_assets:
+//  ./build_level levels/level1.txt dist/level1.levl
+//  ./build_level levels/meadow.txt dist/meadow.levl )
+const build_level_objs = [
+	maek.CPP('build_level.cpp'),
+	maek.CPP('level.cpp'),
+	maek.CPP('world_map.cpp'),
+	maek.CPP('load_save_png.cpp', 'objs/build_load_save_png'),
+];
+const build_level_exe = maek.LINK(build_level_objs, 'build_level');
+
 const game_objs = [
 	maek.CPP('PlayMode.cpp'),
 	maek.CPP('PPU466.cpp'),
+	maek.CPP('PPU466Software.cpp'),
+	maek.CPP('bitplanes.cpp'),
+	maek.CPP('cpu_features.cpp'),
+	maek.CPP('ppu_record.cpp'),
 	maek.CPP('AssetLoader.cpp'),
 	maek.CPP('Sprites.cpp'),
+	maek.CPP('sprite_multiplexer.cpp'),
+	maek.CPP('level.cpp'),
+	maek.CPP('world_map.cpp'),
+	maek.CPP('spatial_grid.cpp'),
+	maek.CPP('patrol.cpp'),
+	maek.CPP('input_record.cpp'),
+	maek.CPP('frame_times.cpp'),
 	maek.CPP('main.cpp'),
+	maek.CPP('frame_capture.cpp'),
 	maek.CPP('load_save_png.cpp', 'objs/game_load_save_png'),  // Separate object file for game
 	maek.CPP('Load.cpp'),
 	maek.CPP('Mode.cpp'),
@@ -146,6 +172,55 @@ const game_objs = [
 //returns exeFile: exeFileBase + a platform-dependant suffix (e.g., '.exe' on windows)
 const game_exe = maek.LINK(game_objs, 'dist/game');
 
+// headless simulation runner (PlayMode without a window; see the top of game-headless.cpp for usage)
+// (goes in dist/ next to the game, so it finds the same data files)
+const game_headless_objs = [
+	maek.CPP('game-headless.cpp'),
+	maek.CPP('work_stealing.cpp'),
+	maek.CPP('PlayMode.cpp'),
+	maek.CPP('PPU466.cpp'),
+	maek.CPP('PPU466Software.cpp'),
+	maek.CPP('bitplanes.cpp'),
+	maek.CPP('cpu_features.cpp'),
+	maek.CPP('ppu_record.cpp'),
+	maek.CPP('AssetLoader.cpp'),
+	maek.CPP('Sprites.cpp'),
+	maek.CPP('sprite_multiplexer.cpp'),
+	maek.CPP('level.cpp'),
+	maek.CPP('world_map.cpp'),
+	maek.CPP('spatial_grid.cpp'),
+	maek.CPP('patrol.cpp'),
+	maek.CPP('input_record.cpp'),
+	maek.CPP('frame_times.cpp'),
+	maek.CPP('Load.cpp'),
+	maek.CPP('Mode.cpp'),
+	...shared_objs
+];
+const game_headless_exe = maek.LINK(game_headless_objs, 'dist/game-headless');
+
+// PPU466 benchmark (runs without a window; see the top of ppu-bench.cpp for usage)
+const ppu_bench_objs = [
+	maek.CPP('ppu-bench.cpp'),
+	maek.CPP('PPU466.cpp'),
+	maek.CPP('PPU466Software.cpp'),
+	maek.CPP('bitplanes.cpp'),
+	maek.CPP('cpu_features.cpp'),
+	maek.CPP('ppu_record.cpp'),
+	maek.CPP('Load.cpp'),
+	...shared_objs
+];
+const ppu_bench_exe = maek.LINK(ppu_bench_objs, 'ppu-bench');
+
+// gameplay benchmark (runs without a window; see the top of game-bench.cpp for usage)
+const game_bench_objs = [
+	maek.CPP('game-bench.cpp'),
+	maek.CPP('spatial_grid.cpp'),
+	maek.CPP('patrol.cpp'),
+	maek.CPP('cpu_features.cpp'),
+	maek.CPP('world_map.cpp'),
+];
+const game_bench_exe = maek.LINK(game_bench_objs, 'game-bench');
+
 // Process assets at build time
 const processed_assets = (() => {
     const inputFiles = [build_assets_exe, 'dist/game1_tileset.png'];
@@ -164,7 +239,7 @@ const processed_assets = (() => {
 })();
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, processed_assets, ...copies];
+maek.TARGETS = [game_exe, game_headless_exe, ppu_bench_exe, game_bench_exe, build_level_exe, processed_assets, ...copies];
 
 //======================================================================
 //Now, onward to the code that makes all this work:
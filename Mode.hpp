@@ -13,12 +13,15 @@ struct Mode : std::enable_shared_from_this< Mode > {
 	//The function should return 'true' if it handled the event.
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) { return false; }
 
-	//update is called at the start of a new frame, after events are handled:
-	// 'elapsed' is time in seconds since the last call to 'update'
+	//update advances the simulation by one fixed-length tick, and is called after events are handled:
+	// 'elapsed' is the tick length in seconds (the same every call; see '--tick-rate' in main.cpp)
+	// It may be called several times per frame (to catch up) or not at all (on fast displays).
 	virtual void update(float elapsed) { }
 
-	//draw is called after update:
-	virtual void draw(glm::uvec2 const &drawable_size) = 0;
+	//draw is called once per frame, after any updates:
+	// 'alpha' in [0,1) is how far real time has moved past the last update, in ticks --
+	//  blend from the previous tick's state to the current one by 'alpha' for smooth motion
+	virtual void draw(glm::uvec2 const &drawable_size, float alpha) = 0;
 
 	//Mode::current is the Mode to which events are dispatched.
 	// use 'set_current' to change the current Mode (e.g., to switch to a menu)
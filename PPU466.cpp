@@ -1,12 +1,19 @@
 #include "PPU466.hpp"
+#include "bitplanes.hpp"
 
 #include "Load.hpp"
 #include "GL.hpp"
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
+#include "gl_state.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 //In order to implement the PPU466 on modern graphics hardware, a fancy, special purpose tile-drawing shader is used:
@@ -24,19 +31,97 @@ struct PPUTileProgram {
 	//Uniform (per-invocation variable) locations:
 	GLuint OBJECT_TO_CLIP_mat4 = -1U;
 
-	//Textures bindings:
-	//TEXTURE0 - the tile table (as a 128x128 R8UI texture)
-	//TEXTURE1 - the palette table (as a 4x8 RGBA8 texture)
+	//Instanced variant of the program (same fragment shader):
+	// each instance is one tile; the vertex shader builds the quad's corners from gl_VertexID.
+	GLuint instanced_program = 0;
+
+	//Attribute (per-instance variable) locations:
+	GLuint InstancePosition_ivec2 = -1U;
+	GLuint InstanceTile_ivec2 = -1U;
+
+	//Uniform locations:
+	GLuint instanced_OBJECT_TO_CLIP_mat4 = -1U;
+
+	//Textures bindings (both programs):
+	//TEXTURE0 - the tile table (as a 128x(8*TileCount/16) R8UI texture; 128x128 in PPU466)
+	//TEXTURE1 - the palette table (as a 4xPaletteCount RGBA8 texture)
+	//(these programs work for every PPU configuration, so there is only one of them)
 };
 
 //Initialize tile program and associated buffers:
 Load< PPUTileProgram > tile_program(LoadTagEarly); //will 'new PPUTileProgram()' by default
 
+//The Tilemap draw path draws the whole background layer as one screen-sized quad,
+// with the fragment shader doing the background, tile, and palette lookups:
+// (the background's size and entry layout are compiled into the shader, so there is one per PPU configuration)
+template< typename PPUType >
+struct PPUBackgroundProgram {
+	PPUBackgroundProgram();
+	~PPUBackgroundProgram();
+
+	GLuint program = 0;
+
+	//(no attributes -- the quad's corners come from gl_VertexID)
+
+	//Uniform (per-invocation variable) locations:
+	GLuint BACKGROUND_POSITION_ivec2 = -1U;
+
+	//Textures bindings:
+	//TEXTURE0 - the tile table (as a 128x(8*TileCount/16) R8UI texture)
+	//TEXTURE1 - the palette table (as a 4xPaletteCount RGBA8 texture)
+	//TEXTURE2 - the background (as a BackgroundWidth x BackgroundHeight R16UI texture)
+};
+
+//Per-configuration GL resources are made the first time a PPU of that configuration draws
+// (not by a Load<> at startup), so a program only pays for the configurations it actually uses:
+// (like Load<>'d resources, they are never freed -- they live as long as the context)
+template< typename PPUType >
+PPUBackgroundProgram< PPUType > const &background_program() {
+	static PPUBackgroundProgram< PPUType > const *program = new PPUBackgroundProgram< PPUType >();
+	return *program;
+}
+
+//Vertex data is streamed through a ring of buffer regions to avoid driver stalls:
+// each upload goes to the next of RegionCount regions of one buffer, written with an unsynchronized
+// map (so the driver never needs to reallocate or wait), and the region is fenced once the draw calls
+// that read it are submitted. The CPU only has to wait when it laps the GPU -- that is, when the GPU
+// still hasn't finished drawing from the region that was written RegionCount uploads ago.
+struct PPUStreamRing {
+	PPUStreamRing(size_t element_size_) : element_size(element_size_) { }
+	~PPUStreamRing();
+	PPUStreamRing(PPUStreamRing const &) = delete;
+
+	static constexpr uint32_t RegionCount = 3;
+
+	GLuint buffer = 0; //buffer (owned by PPUDataStream) holding the regions
+	size_t const element_size; //size of one vertex / instance
+	size_t region_elements = 0; //capacity of each region in elements (grows on demand)
+
+	std::array< GLsync, RegionCount > fences{}; //fence after the last draw from each region (or null)
+	uint32_t next_region = 0;
+
+	//counters since startup:
+	uint64_t uploads = 0; //calls to upload()
+	uint64_t fence_waits = 0; //uploads that had to wait for the GPU
+
+	//copy 'count' elements into the next region and leave 'buffer' bound to GL_ARRAY_BUFFER;
+	// returns the index (in elements) of the first element written, and counts any wait in *waits:
+	size_t upload(void const *data, size_t count, uint32_t *waits);
+
+	//call after submitting the draw calls that read the most recent upload:
+	void fence();
+};
+
 //PPU data is streamed to the GPU (read: uploaded 'just in time') using a few buffers:
+// (buffers and textures are sized for one PPU configuration, so there is one of these per configuration)
+template< typename PPUType >
 struct PPUDataStream {
 	PPUDataStream();
 	~PPUDataStream();
 
+	//the tile table texture holds a grid of tiles 16 wide:
+	static constexpr uint32_t TileRows = PPUType::TileCount / 16;
+
 	//vertex format for convenience:
 	struct Vertex {
 		Vertex(glm::ivec2 const &Position_, glm::ivec2 const &TileCoord_, int32_t const &Palette_)
@@ -47,25 +132,79 @@ struct PPUDataStream {
 		glm::ivec2 TileCoord;
 		int32_t Palette;
 	};
+	static_assert(sizeof(Vertex) == 20, "Vertex is packed");
+
+	//instance format for the instanced path (one per tile):
+	struct Instance {
+		Instance(glm::ivec2 const &Position_, uint32_t tile_index, uint32_t palette_index)
+			: Position(Position_), Tile(tile_index, palette_index) { }
+		glm::i16vec2 Position; //lower-left corner of the tile on the screen
+		glm::u16vec2 Tile; //(tile table index, palette table index)
+	};
+	static_assert(sizeof(Instance) == 8, "Instance is packed");
 
 	//vertex buffer that will store data stream:
 	GLuint vertex_buffer = 0;
+	mutable PPUStreamRing vertex_stream{sizeof(Vertex)}; //(mutable because data_stream() only hands out a const reference)
 
 	//vertex array object that maps tile program attributes to vertex storage:
 	GLuint vertex_buffer_for_tile_program = 0;
 
+	//instance buffer that will store the data stream for the instanced path:
+	GLuint instance_buffer = 0;
+	mutable PPUStreamRing instance_stream{sizeof(Instance)};
+
+	//point the per-instance attributes at a given first instance:
+	// (GL 3.3 has no 'base instance' parameter for draw calls, so this is how a region of instance_buffer is selected)
+	void point_instance_attributes(size_t first_instance) const;
+
+	//vertex array object that maps instanced tile program attributes to instance storage:
+	GLuint instance_buffer_for_instanced_tile_program = 0;
+
+	//vertex array object with no attributes, for the background program's screen quad:
+	GLuint empty_vertex_array = 0;
+
 	//texture object that will store tile table:
 	GLuint tile_tex = 0;
 
 	//texture object that will store palette table:
 	GLuint palette_tex = 0;
+
+	//texture object that will store the background (as an R16UI texture, for the Tilemap path):
+	GLuint background_tex = 0;
+
+	//native-resolution render target (ScreenWidth x ScreenHeight RGBA8), upscaled to the drawable by blitting:
+	GLuint native_tex = 0;
+	GLuint native_fb = 0;
+
+	//CPU-side record of what tile_tex currently holds, so draw() only decodes + uploads changed tiles:
+	// (mutable because data_stream() only hands out a const reference)
+	mutable bool tile_tex_valid = false; //false until the first full upload
+	mutable std::array< PPUBase::Tile, PPUType::TileCount > uploaded_tiles; //tile table as of the last upload
+	mutable std::array< uint8_t, 128 * (8 * TileRows) > tile_indices; //decoded copy of tile_tex's contents
+
+	//same for palette_tex:
+	mutable bool palette_tex_valid = false;
+	mutable std::array< PPUBase::Palette, PPUType::PaletteCount > uploaded_palettes;
+
+	//same for background_tex:
+	mutable bool background_tex_valid = false;
+	mutable std::array< uint16_t, PPUType::BackgroundWidth * PPUType::BackgroundHeight > uploaded_background;
+	//PPU whose draw() last updated background_tex (its background_rows_changed hint is relative to that draw):
+	mutable PPUType const *background_owner = nullptr;
 };
 
-Load< PPUDataStream > data_stream(LoadTagDefault);
+//(made on first use, like background_program above)
+template< typename PPUType >
+PPUDataStream< PPUType > const &data_stream() {
+	static PPUDataStream< PPUType > const *stream = new PPUDataStream< PPUType >();
+	return *stream;
+}
 
 //-------------------------------------------------------------------
 
-PPU466::PPU466() {
+template< uint32_t S, uint32_t T, uint32_t P, uint32_t W, uint32_t H >
+PPU< S, T, P, W, H >::PPU() {
 	for (auto &palette : palette_table) {
 		palette[0] = glm::u8vec4(0x00, 0x00, 0x00, 0x00);
 		palette[1] = glm::u8vec4(0x44, 0x44, 0x44, 0xff);
@@ -79,55 +218,121 @@ PPU466::PPU466() {
 	}
 
 	for (uint32_t i = 0; i < background.size(); ++i) {
-		background[i] = int16_t(
-			  (i % 8) << 8 //cycle through all palettes
+		background[i] = uint16_t(
+			  (i % PaletteCount) << BackgroundPaletteShift //cycle through all palettes
 			| (i % palette_table.size()) //cycle through all tiles
 		);
 	}
 }
 
-void PPU466::draw(glm::uvec2 const &drawable_size) const {
-	//this code does screen scaling by manipulating the viewport, so save old values:
-	GLint old_viewport[4];
-	glGetIntegerv(GL_VIEWPORT, old_viewport);
+template< uint32_t S, uint32_t T, uint32_t P, uint32_t W, uint32_t H >
+void PPU< S, T, P, W, H >::animate_palettes(uint32_t frames) {
+	//the palette table, viewed as one array of 4 * PaletteCount colors:
+	static_assert(sizeof(palette_table) == sizeof(glm::u8vec4) * 4 * PaletteCount, "palette table is packed");
+	glm::u8vec4 *entries = palette_table[0].data();
+	uint32_t const entry_count = uint32_t(4 * palette_table.size());
+
+	for (auto &cycle : palette_cycles) {
+		uint32_t first = std::min< uint32_t >(cycle.first, entry_count);
+		uint32_t count = std::min< uint32_t >(cycle.count, entry_count - first);
+		uint32_t frames_per_step = std::max< uint32_t >(1, cycle.frames_per_step);
+
+		uint32_t elapsed = cycle.timer + frames;
+		uint32_t steps = elapsed / frames_per_step;
+		cycle.timer = uint16_t(elapsed % frames_per_step);
+		if (count < 2) continue;
+		steps %= count;
+		if (steps == 0) continue;
+
+		//colors move toward higher entries, so the last 'steps' colors wrap around to the front:
+		if (cycle.reverse) steps = count - steps;
+		std::rotate(entries + first, entries + first + (count - steps), entries + first + count);
+	}
+
+	for (auto &anim : palette_keyframes) {
+		if (anim.keys.empty() || anim.palette >= palette_table.size()) continue;
+		uint32_t frames_per_key = std::max< uint32_t >(1, anim.frames_per_key);
+		uint32_t length = uint32_t(anim.keys.size()) * frames_per_key;
+
+		//show the key for the current frame, then move on:
+		// (so the first call shows keys[0] and every key is held for exactly frames_per_key calls)
+		if (anim.loop) anim.frame %= length;
+		else anim.frame = std::min(anim.frame, length - 1);
+		palette_table[anim.palette] = anim.keys[anim.frame / frames_per_key];
+		anim.frame += frames;
+	}
+}
+
+template< uint32_t S, uint32_t T, uint32_t P, uint32_t W, uint32_t H >
+uint32_t PPU< S, T, P, W, H >::native_texture() const {
+	return data_stream< PPU >().native_tex;
+}
+
+template< uint32_t S, uint32_t T, uint32_t P, uint32_t W, uint32_t H >
+void PPU< S, T, P, W, H >::draw(glm::uvec2 const &drawable_size, DrawStats *stats) const {
+	PPUDataStream< PPU > const &stream = data_stream< PPU >();
+
+	//when asked for stats, time each stage of the draw:
+	// (end_stage adds the time since the previous end_stage to the given counter)
+	if (stats) *stats = DrawStats();
+	auto stage_start = std::chrono::high_resolution_clock::now();
+	auto end_stage = [&stats,&stage_start](float DrawStats::*stage_ms) {
+		if (!stats) return;
+		auto now = std::chrono::high_resolution_clock::now();
+		stats->*stage_ms += std::chrono::duration< float, std::milli >(now - stage_start).count();
+		stage_start = now;
+	};
+
+	//count this draw's state changes separately from the rest of the frame's:
+	GLState::Counts const counts_before = gl_state.frame;
 
-	//draw to whole drawable:
-	glViewport(0,0,drawable_size.x,drawable_size.y);
+	//this code changes the viewport and framebuffer bindings, so remember old values:
+	// (gl_state answers from its shadow copy, so this doesn't cost a glGet)
+	glm::ivec4 const old_viewport = gl_state.viewport();
+	GLuint const old_draw_framebuffer = gl_state.draw_framebuffer();
+	GLuint const old_read_framebuffer = gl_state.read_framebuffer();
+
+	//everything is drawn at native (ScreenWidth x ScreenHeight) resolution into native_fb,
+	// which is then scaled up to the drawable in a single blit at the end:
+	// (so fragment work doesn't depend on window size)
+	gl_state.bind_framebuffer(GL_FRAMEBUFFER, stream.native_fb);
+	gl_state.viewport(0, 0, ScreenWidth, ScreenHeight);
 
 	//background gets background color:
-	glClearColor(
+	gl_state.clear_color(glm::vec4(
 		background_color.r / 255.0f, 
 		background_color.g / 255.0f, 
 		background_color.b / 255.0f,
 		1.0f
-	);
+	));
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	//set up screen scaling:
-	if (drawable_size.x < ScreenWidth || drawable_size.y < ScreenHeight) {
-		//if screen is too small, just do some inglorious pixel-mushing:
-		//(viewport is already set. nothing more to do.)
-	} else {
-		//otherwise, do careful integer-multiple upscaling:
-		//largest size that will fit in the drawable:
-		const uint32_t scale = std::max( 1U, std::min(drawable_size.x / ScreenWidth, drawable_size.y / ScreenHeight) );
+	end_stage(&DrawStats::submit_ms);
 
-		//compute lower left so that screen is centered:
-		const glm::ivec2 lower_left = glm::ivec2(
-			(int32_t(drawable_size.x) - scale * int32_t(ScreenWidth)) / 2,
-			(int32_t(drawable_size.y) - scale * int32_t(ScreenHeight)) / 2
-		);
-		glViewport(lower_left.x, lower_left.y, scale * ScreenWidth, scale * ScreenHeight);
-	}
+	//build triangle strip (or instance list) representing background and sprites:
+	// (the Tilemap path only puts sprites here; its background is drawn from background_tex)
 
-	//build triangle strip representing background and sprites:
+	bool const cpu_background = (draw_path != DrawPath::Tilemap);
 
-	constexpr uint32_t TristripSize = uint32_t(6 * (BackgroundWidth * BackgroundHeight + decltype(sprites)().size()));
-	std::vector< PPUDataStream::Vertex > triangle_strip;
-	triangle_strip.reserve(TristripSize);
+	//at most 33x31 background tiles can overlap the screen (when it is scrolled to a non-multiple of 8):
+	constexpr uint32_t MaxVisibleBackgroundTiles = (ScreenWidth / 8 + 1) * (ScreenHeight / 8 + 1);
+	uint32_t const MaxTileCount = uint32_t((cpu_background ? MaxVisibleBackgroundTiles : 0) + SpriteCount);
+	std::vector< typename PPUDataStream< PPU >::Vertex > triangle_strip;
+	std::vector< typename PPUDataStream< PPU >::Instance > instances;
+	if (draw_path == DrawPath::Instanced) {
+		instances.reserve(MaxTileCount);
+	} else {
+		triangle_strip.reserve(6 * MaxTileCount);
+	}
 
 	//helper to put a single tile somewhere on the screen:
-	auto draw_tile = [&triangle_strip](glm::ivec2 const &lower_left, uint8_t tile_index, uint8_t palette_index){
+	auto draw_tile = [this,&triangle_strip,&instances](glm::ivec2 const &lower_left, uint32_t tile_index, uint32_t palette_index){
+		if (draw_path == DrawPath::Instanced) {
+			//the vertex shader does the rest:
+			instances.emplace_back(lower_left, tile_index, palette_index);
+			return;
+		}
+
 		//convert tile index to lower-left pixel coordinate in tile image:
 		glm::ivec2 tile_coord = glm::ivec2((tile_index % 16)*8, (tile_index / 16)*8);
 
@@ -147,151 +352,334 @@ void PPU466::draw(glm::uvec2 const &drawable_size) const {
 			draw_tile(
 				glm::ivec2(sprite.x, sprite.y),
 				sprite.index,
-				sprite.attributes & 0x07 //just the palette index part
+				sprite.attributes & SpritePaletteMask //just the palette index part
 			);
 		}
 	};
 
 	draw_sprites(0x80); //draw sprites with priority == 1 ('behind' sprites)
 
-	{ //draw the background:
-		//To simulate the 'infinite tiling' behavior this code draws the background as four screen-sized chunks,
-		// each of which is drawn at an offset that causes it to overlap the screen.
+	//number of tiles drawn before the background layer in the Tilemap path:
+	uint32_t const behind_sprites = uint32_t(triangle_strip.size() / 6);
 
-		static_assert(BackgroundWidth * 8 == ScreenWidth * 2, "Background should be exactly twice the screen width.");
-		static_assert(BackgroundHeight * 8 == ScreenHeight * 2, "Background should be exactly twice the screen height.");
+	uint32_t background_tiles = 0; //number of background tiles emitted
 
-		for (int32_t chunk_y : {0, int32_t(ScreenHeight)}) {
-			for (int32_t chunk_x : {0, int32_t(ScreenWidth)}) {
-				//position of the lower-left corner of the chunk:
-				glm::ivec2 pos = glm::ivec2(chunk_x, chunk_y) + background_position;
+	if (cpu_background) { //draw the background:
+		//Only tiles that overlap the screen are emitted, walking the (wrapping) background
+		// starting from the tile under the lower-left screen pixel.
 
-				constexpr int32_t BackgroundWidthPixels = int32_t(BackgroundWidth) * 8;
-				constexpr int32_t BackgroundHeightPixels = int32_t(BackgroundHeight) * 8;
+		constexpr int32_t BackgroundWidthPixels = int32_t(BackgroundWidth) * 8;
+		constexpr int32_t BackgroundHeightPixels = int32_t(BackgroundHeight) * 8;
 
-				//reduce to (-BackgroundWidthPixels,0] x (-BackgroundHeightPixels,0]:
-				pos.x = ((pos.x % BackgroundWidthPixels) - BackgroundWidthPixels) % BackgroundWidthPixels;
-				pos.y = ((pos.y % BackgroundHeightPixels) - BackgroundHeightPixels) % BackgroundHeightPixels;
-
-				//move chunk if it doesn't overlap the screen:
-				if (pos.x + int32_t(ScreenWidth) <= 0) pos.x += BackgroundWidthPixels;
-				if (pos.y + int32_t(ScreenHeight) <= 0) pos.y += BackgroundHeightPixels;
-
-				int32_t ox = chunk_x / 8;
-				int32_t oy = chunk_y / 8;
-				for (int32_t y = 0; y < int32_t(BackgroundHeight)/2; ++y) {
-					for (int32_t x = 0; x < int32_t(BackgroundWidth)/2; ++x) {
-						uint16_t info = background[(x + ox) + BackgroundWidth * (y + oy)];
-						draw_tile(
-							glm::ivec2(pos.x + 8*x, pos.y + 8*y),
-							info & 0xff, //extract tile index bits
-							(info >> 8) & 0x07 //extract palette index bits
-						);
-					}
-				}
+		//background pixel that lands on screen pixel (0,0), reduced to [0,BackgroundWidthPixels) x [0,BackgroundHeightPixels):
+		glm::ivec2 origin = glm::ivec2(
+			((-background_position.x % BackgroundWidthPixels) + BackgroundWidthPixels) % BackgroundWidthPixels,
+			((-background_position.y % BackgroundHeightPixels) + BackgroundHeightPixels) % BackgroundHeightPixels
+		);
 
+		//tile containing that pixel, and where that tile's lower-left corner ends up on the screen:
+		glm::ivec2 first_tile = glm::ivec2(origin.x / 8, origin.y / 8);
+		glm::ivec2 first_pos = glm::ivec2(-(origin.x % 8), -(origin.y % 8));
+
+		//tiles needed to cover the screen (one extra when the first tile is partly off the edge):
+		int32_t const columns = int32_t(ScreenWidth / 8) + (first_pos.x < 0 ? 1 : 0);
+		int32_t const rows = int32_t(ScreenHeight / 8) + (first_pos.y < 0 ? 1 : 0);
+
+		for (int32_t y = 0; y < rows; ++y) {
+			int32_t ty = (first_tile.y + y) % int32_t(BackgroundHeight);
+			for (int32_t x = 0; x < columns; ++x) {
+				int32_t tx = (first_tile.x + x) % int32_t(BackgroundWidth);
+				uint16_t info = background[tx + BackgroundWidth * ty];
+				draw_tile(
+					glm::ivec2(first_pos.x + 8*x, first_pos.y + 8*y),
+					info & BackgroundTileMask, //extract tile index bits
+					(info >> BackgroundPaletteShift) & BackgroundPaletteMask //extract palette index bits
+				);
 			}
 		}
+
+		background_tiles = uint32_t(columns * rows);
 	}
 
 	draw_sprites(0x00); //draw sprites with priority == 0 ('in front' sprites)
 
-	assert(triangle_strip.size() == TristripSize && "Triangle strip size was estimated exactly.");
+	uint32_t const tiles_emitted = uint32_t(draw_path == DrawPath::Instanced ? instances.size() : triangle_strip.size() / 6);
+	assert(tiles_emitted == background_tiles + SpriteCount && "Every background tile and sprite was emitted once.");
+	assert(tiles_emitted <= MaxTileCount && "Visible tile count stayed within the reserved space.");
+
+	if (stats) {
+		stats->tiles_drawn = tiles_emitted;
+		stats->background_tiles = background_tiles;
+	}
+	end_stage(&DrawStats::build_ms);
 
 	//-------------------------------------------------
 	//Upload at to GPU using PPUDataStream:
 
-	{ //upload palette texture:
+	//upload palette texture (only if some color changed since the last upload):
+	if (!stream.palette_tex_valid || palette_table != stream.uploaded_palettes) {
 		static_assert(sizeof(palette_table) == 4 * 4 * decltype(palette_table)().size(), "palette table is packed");
-		glBindTexture(GL_TEXTURE_2D, data_stream->palette_tex);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 4, GLsizei(palette_table.size()), 0, GL_RGBA, GL_UNSIGNED_BYTE, palette_table.data());
-		glBindTexture(GL_TEXTURE_2D, 0);
-	}
-
-	{ //build + upload tile table texture:
-		//interpret tiles and build a 128 x 128 index texture:
-		static std::array< uint8_t, 128 * 128 > data;
-		for (uint32_t i = 0; i < tile_table.size(); ++i) {
-			Tile const &tile = tile_table[i];
-
-			//location of tile in the texture:
-			uint32_t ox = (i % 16) * 8;
-			uint32_t oy = (i / 16) * 8;
-
-			//copy tile indices into texture:
-			for (uint32_t y = 0; y < 8; ++y) {
-				for (uint32_t x = 0; x < 8; ++x) {
-					data[ox+x + 128 * (oy+y)] =
-						  ((tile.bit0[y] >> x) & 1)
-						| ((tile.bit1[y] >> x) & 1) << 1;
-				}
+		gl_state.bind_texture(stream.palette_tex);
+		//(every upload sets its own row length -- the cached value is whatever the last upload, maybe last frame, left)
+		gl_state.unpack_row_length(0);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 4, GLsizei(palette_table.size()), GL_RGBA, GL_UNSIGNED_BYTE, palette_table.data());
+
+		stream.uploaded_palettes = palette_table;
+		stream.palette_tex_valid = true;
+		if (stats) stats->palette_uploads += 1;
+	}
+
+	{ //update tile table texture:
+		//the tile texture is a 128-pixel-wide index image holding the grid of tiles (16 tiles per row).
+		//only tiles that differ from the last upload are decoded, and each row of the
+		//tile grid gets (at most) one glTexSubImage2D call covering its changed tiles:
+		constexpr uint32_t TileRows = PPUDataStream< PPU >::TileRows;
+		auto &data = stream.tile_indices;
+		auto &uploaded = stream.uploaded_tiles;
+		bool const upload_all = !stream.tile_tex_valid;
+
+		//changed span of each row of the tile grid:
+		std::array< uint32_t, TileRows > first; //first changed tile in each row
+		std::array< uint32_t, TileRows > last; //last changed tile in each row
+		first.fill(16);
+		last.fill(0);
+
+		end_stage(&DrawStats::upload_ms);
+
+		for (uint32_t row = 0; row < TileRows; ++row) {
+			for (uint32_t col = 0; col < 16; ++col) {
+				uint32_t i = col + 16 * row;
+				Tile const &tile = tile_table[i];
+				if (!upload_all
+				 && tile.bit0 == uploaded[i].bit0
+				 && tile.bit1 == uploaded[i].bit1) continue;
+
+				uploaded[i] = tile;
+				first[row] = std::min(first[row], col);
+				last[row] = std::max(last[row], col);
+				if (stats) stats->tiles_decoded += 1;
+
+				//decode tile indices into their place in the texture:
+				decode_tile(tile, data.data() + col * 8 + 128 * (row * 8), 128);
 			}
 		}
 
-		glBindTexture(GL_TEXTURE_2D, data_stream->tile_tex);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, 128, 128, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data.data());
-		glBindTexture(GL_TEXTURE_2D, 0);
+		end_stage(&DrawStats::decode_ms);
+
+		gl_state.bind_texture(stream.tile_tex);
+		//rows of the sub-images are read from within the full 128-wide decoded image:
+		gl_state.unpack_row_length(128);
+
+		for (uint32_t row = 0; row < TileRows; ++row) {
+			if (first[row] > last[row]) continue; //nothing changed in this row
+
+			glTexSubImage2D(GL_TEXTURE_2D, 0,
+				GLint(first[row] * 8), GLint(row * 8), //offset
+				GLsizei((last[row] - first[row] + 1) * 8), 8, //size
+				GL_RED_INTEGER, GL_UNSIGNED_BYTE,
+				data.data() + first[row] * 8 + 128 * (row * 8)
+			);
+		}
+
+		stream.tile_tex_valid = true;
 	}
 
-	{ //upload vertex data:
-		glBindBuffer(GL_ARRAY_BUFFER, data_stream->vertex_buffer);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(decltype(triangle_strip[0])) * triangle_strip.size(), triangle_strip.data(), GL_STREAM_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (!cpu_background) { //update background texture:
+		//same idea as the tile texture: only the changed span of each background row is uploaded.
+		auto &uploaded = stream.uploaded_background;
+		bool const upload_all = !stream.background_tex_valid;
+		//rows to compare: only the hinted ones if the texture holds this PPU's background as of its last draw():
+		uint64_t const check_rows = (upload_all || stream.background_owner != this) ? ~uint64_t(0) : background_rows_changed;
+
+		gl_state.bind_texture(stream.background_tex);
+		gl_state.unpack_row_length(BackgroundWidth);
+
+		for (uint32_t y = 0; y < BackgroundHeight; ++y) {
+			if (!((check_rows >> y) & 1)) continue;
+			uint32_t first = BackgroundWidth; //first changed entry in this row
+			uint32_t last = 0; //last changed entry in this row
+			for (uint32_t x = 0; x < BackgroundWidth; ++x) {
+				uint32_t i = x + BackgroundWidth * y;
+				if (!upload_all && background[i] == uploaded[i]) continue;
+				uploaded[i] = background[i];
+				first = std::min(first, x);
+				last = std::max(last, x);
+			}
+
+			if (first > last) continue; //nothing changed in this row
+
+			glTexSubImage2D(GL_TEXTURE_2D, 0,
+				GLint(first), GLint(y), //offset
+				GLsizei(last - first + 1), 1, //size
+				GL_RED_INTEGER, GL_UNSIGNED_SHORT,
+				background.data() + first + BackgroundWidth * y
+			);
+		}
+
+		stream.background_tex_valid = true;
+		stream.background_owner = this;
+	} else {
+		//(the texture is now behind this PPU by whatever changed since its last Tilemap draw)
+		if (stream.background_owner == this) stream.background_owner = nullptr;
+	}
+	//the hint has been used (or, with the owner reset above, will be ignored next time):
+	background_rows_changed = 0;
+
+	//index of this draw's first vertex (or instance) within its stream's buffer:
+	size_t first = 0;
+
+	if (draw_path == DrawPath::Instanced) { //upload instance data:
+		first = stream.instance_stream.upload(instances.data(), instances.size(), stats ? &stats->fence_waits : nullptr);
+		gl_state.bind_vertex_array(stream.instance_buffer_for_instanced_tile_program);
+		stream.point_instance_attributes(first);
+	} else { //upload vertex data:
+		first = stream.vertex_stream.upload(triangle_strip.data(), triangle_strip.size(), stats ? &stats->fence_waits : nullptr);
 	}
 
 	//set up the pipeline:
 	// set blending function for output fragments:
-	glEnable(GL_BLEND);
-	glBlendEquation(GL_FUNC_ADD);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-	// set the shader programs:
-	glUseProgram(tile_program->program);
-
-	// configure attribute streams:
-	glBindVertexArray(data_stream->vertex_buffer_for_tile_program);
-
-	// set uniforms for shader programs:
-	{ //set matrix to transform [0,ScreenWidth]x[0,ScreenHeight] -> [-1,1]x[-1,1]:
-		//NOTE: glm uses column-major matrices:
-		glm::mat4 OBJECT_TO_CLIP = glm::mat4(
-			glm::vec4(2.0f / float(ScreenWidth), 0.0f, 0.0f, 0.0f),
-			glm::vec4(0.0f, 2.0f / float(ScreenHeight), 0.0f, 0.0f),
-			glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
-			glm::vec4(-1.0f,-1.0f, 0.0f, 1.0f)
-		);
+	// (bindings are left in place after drawing -- gl_state makes re-setting them next frame free)
+	gl_state.blend(true);
+	gl_state.blend_equation(GL_FUNC_ADD);
+	gl_state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	end_stage(&DrawStats::upload_ms);
+
+	//matrix to transform [0,ScreenWidth]x[0,ScreenHeight] -> [-1,1]x[-1,1]:
+	//NOTE: glm uses column-major matrices:
+	glm::mat4 const OBJECT_TO_CLIP = glm::mat4(
+		glm::vec4(2.0f / float(ScreenWidth), 0.0f, 0.0f, 0.0f),
+		glm::vec4(0.0f, 2.0f / float(ScreenHeight), 0.0f, 0.0f),
+		glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
+		glm::vec4(-1.0f,-1.0f, 0.0f, 1.0f)
+	);
+
+	// bind texture units to proper texture objects:
+	gl_state.active_texture(GL_TEXTURE2);
+	gl_state.bind_texture(stream.background_tex);
+	gl_state.active_texture(GL_TEXTURE1);
+	gl_state.bind_texture(stream.palette_tex);
+	gl_state.active_texture(GL_TEXTURE0);
+	gl_state.bind_texture(stream.tile_tex);
+
+	if (draw_path == DrawPath::Instanced) {
+		// set the shader program, attribute streams, and uniforms:
+		gl_state.use_program(tile_program->instanced_program);
+		gl_state.bind_vertex_array(stream.instance_buffer_for_instanced_tile_program);
+		glUniformMatrix4fv(tile_program->instanced_OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(OBJECT_TO_CLIP));
+
+		//now that the pipeline is configured, trigger drawing (each instance is a four-vertex triangle strip):
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(instances.size()));
+	} else {
+		// set the shader program, attribute streams, and uniforms:
+		gl_state.use_program(tile_program->program);
+		gl_state.bind_vertex_array(stream.vertex_buffer_for_tile_program);
 		glUniformMatrix4fv(tile_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(OBJECT_TO_CLIP));
+
+		if (cpu_background) {
+			//now that the pipeline is configured, trigger drawing of triangle strip:
+			glDrawArrays(GL_TRIANGLE_STRIP, GLint(first), GLsizei(triangle_strip.size()));
+		} else {
+			//'behind' sprites:
+			glDrawArrays(GL_TRIANGLE_STRIP, GLint(first), GLsizei(6 * behind_sprites));
+
+			//background layer as a single screen-covering quad:
+			gl_state.use_program(background_program< PPU >().program);
+			gl_state.bind_vertex_array(stream.empty_vertex_array);
+			{ //background position, reduced to [0,BackgroundWidthPixels) x [0,BackgroundHeightPixels) so the shader doesn't need to deal with negative values:
+				constexpr int32_t BackgroundWidthPixels = int32_t(BackgroundWidth) * 8;
+				constexpr int32_t BackgroundHeightPixels = int32_t(BackgroundHeight) * 8;
+				glm::ivec2 pos = background_position;
+				pos.x = ((pos.x % BackgroundWidthPixels) + BackgroundWidthPixels) % BackgroundWidthPixels;
+				pos.y = ((pos.y % BackgroundHeightPixels) + BackgroundHeightPixels) % BackgroundHeightPixels;
+				glUniform2i(background_program< PPU >().BACKGROUND_POSITION_ivec2, pos.x, pos.y);
+			}
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+			//'in front' sprites:
+			gl_state.use_program(tile_program->program);
+			gl_state.bind_vertex_array(stream.vertex_buffer_for_tile_program);
+			glDrawArrays(GL_TRIANGLE_STRIP, GLint(first + 6 * behind_sprites), GLsizei(triangle_strip.size() - 6 * behind_sprites));
+		}
 	}
 
-	// bind texture units to proper texture objects:
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, data_stream->palette_tex);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, data_stream->tile_tex);
+	//the GPU is now (eventually) going to read this draw's stream region:
+	if (draw_path == DrawPath::Instanced) {
+		stream.instance_stream.fence();
+	} else {
+		stream.vertex_stream.fence();
+	}
+
+	//-------------------------------------------------
+	//Scale the native-resolution image up to the drawable:
+
+	//where the screen lands in the drawable:
+	glm::ivec2 lower_left = glm::ivec2(0,0);
+	glm::ivec2 size = glm::ivec2(drawable_size);
+	if (drawable_size.x < ScreenWidth || drawable_size.y < ScreenHeight) {
+		//if screen is too small, just do some inglorious pixel-mushing:
+		//(stretch over the whole drawable. nothing more to do.)
+	} else {
+		//otherwise, do careful integer-multiple upscaling:
+		//largest size that will fit in the drawable:
+		const uint32_t scale = std::max( 1U, std::min(drawable_size.x / ScreenWidth, drawable_size.y / ScreenHeight) );
+		size = glm::ivec2(scale * ScreenWidth, scale * ScreenHeight);
+
+		//compute lower left so that screen is centered:
+		lower_left = glm::ivec2(
+			(int32_t(drawable_size.x) - size.x) / 2,
+			(int32_t(drawable_size.y) - size.y) / 2
+		);
+	}
 
-	//now that the pipeline is configured, trigger drawing of triangle strip:
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, GLsizei(triangle_strip.size()));
+	//(neither glClear nor glBlitFramebuffer is limited by the viewport, so it stays native-sized until the end)
+	gl_state.bind_framebuffer(GL_DRAW_FRAMEBUFFER, old_draw_framebuffer);
 
-	//return state to default:
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	//area around the screen also gets background color (clear color is still set from above):
+	if (size != glm::ivec2(drawable_size)) {
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
 
-	glBindVertexArray(0);
-	glUseProgram(0);
+	glBlitFramebuffer(
+		0, 0, ScreenWidth, ScreenHeight,
+		lower_left.x, lower_left.y, lower_left.x + size.x, lower_left.y + size.y,
+		GL_COLOR_BUFFER_BIT, GL_NEAREST
+	);
+	gl_state.bind_framebuffer(GL_READ_FRAMEBUFFER, old_read_framebuffer);
 
-	glDisable(GL_BLEND);
+	//restore viewport, since the native-resolution drawing changed it:
+	gl_state.viewport(old_viewport);
 
-	//also restore viewport, since earlier scaling code messed with it:
-	glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+	if (stats) {
+		stats->gl_state_changes = gl_state.frame.changes - counts_before.changes;
+		stats->gl_state_skipped = gl_state.frame.skipped - counts_before.skipped;
+	}
 
 	GL_ERRORS();
+
+	end_stage(&DrawStats::submit_ms);
 }
 
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+//both tile programs share the same fragment shader:
+static const char *TileFragmentShader =
+	"#version 330\n"
+	"uniform usampler2D TILE_TABLE;\n"
+	"uniform sampler2D PALETTE_TABLE;\n"
+	"in vec2 tileCoord;\n"
+	"flat in int palette;\n" //"flat" means "uses the value of the provoking [by default, last] vertex in the primitive"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	uint index = texelFetch(TILE_TABLE, ivec2(tileCoord), 0).r;\n"
+	"	fragColor = texelFetch(PALETTE_TABLE, ivec2(index, palette), 0);\n"
+	//"	fragColor = vec4(float(index)/4.0,float(palette)/8,1,1);\n"
+	//"	fragColor = texelFetch(TILE_TABLE, ivec2(int(gl_FragCoord.x) % textureSize(TILE_TABLE,0).x, int(gl_FragCoord.y) % textureSize(TILE_TABLE,0).y), 0);\n"
+	//"	fragColor = texelFetch(PALETTE_TABLE, ivec2(int(gl_FragCoord.x) % textureSize(PALETTE_TABLE,0).x, int(gl_FragCoord.y) % textureSize(PALETTE_TABLE,0).y), 0);\n"
+	"}\n"
+;
+
 PPUTileProgram::PPUTileProgram() {
 	program = gl_compile_program(
 		//vertex shader:
@@ -309,19 +697,7 @@ PPUTileProgram::PPUTileProgram() {
 		"}\n"
 	,
 		//fragment shader:
-		"#version 330\n"
-		"uniform usampler2D TILE_TABLE;\n"
-		"uniform sampler2D PALETTE_TABLE;\n"
-		"in vec2 tileCoord;\n"
-		"flat in int palette;\n" //"flat" means "uses the value of the provoking [by default, last] vertex in the primitive"
-		"out vec4 fragColor;\n"
-		"void main() {\n"
-		"	uint index = texelFetch(TILE_TABLE, ivec2(tileCoord), 0).r;\n"
-		"	fragColor = texelFetch(PALETTE_TABLE, ivec2(index, palette), 0);\n"
-		//"	fragColor = vec4(float(index)/4.0,float(palette)/8,1,1);\n"
-		//"	fragColor = texelFetch(TILE_TABLE, ivec2(int(gl_FragCoord.x) % textureSize(TILE_TABLE,0).x, int(gl_FragCoord.y) % textureSize(TILE_TABLE,0).y), 0);\n"
-		//"	fragColor = texelFetch(PALETTE_TABLE, ivec2(int(gl_FragCoord.x) % textureSize(PALETTE_TABLE,0).x, int(gl_FragCoord.y) % textureSize(PALETTE_TABLE,0).y), 0);\n"
-		"}\n"
+		TileFragmentShader
 	);
 
 	//look up the locations of vertex attributes:
@@ -336,10 +712,43 @@ PPUTileProgram::PPUTileProgram() {
 	GLuint PALETTE_TABLE_sampler2D = glGetUniformLocation(program, "PALETTE_TABLE");
 
 	//bind texture units indices to samplers:
-	glUseProgram(program);
+	gl_state.use_program(program);
 	glUniform1i(TILE_TABLE_usampler2D, 0);
 	glUniform1i(PALETTE_TABLE_sampler2D, 1);
-	glUseProgram(0);
+	gl_state.use_program(0);
+
+	instanced_program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"uniform mat4 OBJECT_TO_CLIP;\n"
+		"in ivec2 InstancePosition;\n"
+		"in ivec2 InstanceTile;\n" //(tile index, palette index)
+		"out vec2 tileCoord;\n"
+		"flat out int palette;\n"
+		"void main() {\n"
+		//corners in the same order as the triangle strip path: (0,0), (0,8), (8,0), (8,8):
+		"	ivec2 corner = 8 * ivec2(gl_VertexID >> 1, gl_VertexID & 1);\n"
+		"	gl_Position = OBJECT_TO_CLIP * vec4(InstancePosition + corner, 0.0, 1.0);\n"
+		"	tileCoord = 8 * ivec2(InstanceTile.x % 16, InstanceTile.x / 16) + corner;\n"
+		"	palette = InstanceTile.y;\n"
+		"}\n"
+	,
+		//fragment shader:
+		TileFragmentShader
+	);
+
+	//look up the locations of instance attributes:
+	InstancePosition_ivec2 = glGetAttribLocation(instanced_program, "InstancePosition");
+	InstanceTile_ivec2 = glGetAttribLocation(instanced_program, "InstanceTile");
+
+	//look up the locations of uniforms:
+	instanced_OBJECT_TO_CLIP_mat4 = glGetUniformLocation(instanced_program, "OBJECT_TO_CLIP");
+
+	//bind texture units indices to samplers:
+	gl_state.use_program(instanced_program);
+	glUniform1i(glGetUniformLocation(instanced_program, "TILE_TABLE"), 0);
+	glUniform1i(glGetUniformLocation(instanced_program, "PALETTE_TABLE"), 1);
+	gl_state.use_program(0);
 
 	GL_ERRORS();
 }
@@ -349,21 +758,90 @@ PPUTileProgram::~PPUTileProgram() {
 		glDeleteProgram(program);
 		program = 0;
 	}
+	if (instanced_program != 0) {
+		glDeleteProgram(instanced_program);
+		instanced_program = 0;
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+template< typename PPUType >
+PPUBackgroundProgram< PPUType >::PPUBackgroundProgram() {
+	static_assert(PPUType::ScreenWidth == 256 && PPUType::ScreenHeight == 240, "shader constants match screen size");
+
+	//configuration-dependent constants for the fragment shader:
+	std::string const BackgroundPixels = "ivec2(" + std::to_string(PPUType::BackgroundWidth * 8) + ", " + std::to_string(PPUType::BackgroundHeight * 8) + ")";
+	std::string const TileMask = std::to_string(PPUType::BackgroundTileMask) + "u";
+	std::string const PaletteShift = std::to_string(PPUType::BackgroundPaletteShift);
+	std::string const PaletteMask = std::to_string(PPUType::BackgroundPaletteMask) + "u";
+
+	program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"out vec2 screenCoord;\n"
+		"void main() {\n"
+		"	vec2 corner = vec2(gl_VertexID >> 1, gl_VertexID & 1);\n"
+		"	gl_Position = vec4(2.0 * corner - 1.0, 0.0, 1.0);\n"
+		"	screenCoord = corner * vec2(256.0, 240.0);\n"
+		"}\n"
+	,
+		//fragment shader:
+		"#version 330\n"
+		"uniform usampler2D TILE_TABLE;\n"
+		"uniform sampler2D PALETTE_TABLE;\n"
+		"uniform usampler2D BACKGROUND;\n"
+		"uniform ivec2 BACKGROUND_POSITION;\n" //already reduced to [0,BackgroundWidth*8)x[0,BackgroundHeight*8)
+		"const ivec2 BACKGROUND_PIXELS = " + BackgroundPixels + ";\n"
+		"in vec2 screenCoord;\n"
+		"out vec4 fragColor;\n"
+		"void main() {\n"
+		//background pixel under this screen pixel (wrapping around):
+		"	ivec2 px = (ivec2(screenCoord) - BACKGROUND_POSITION + BACKGROUND_PIXELS) % BACKGROUND_PIXELS;\n"
+		"	uint info = texelFetch(BACKGROUND, px / 8, 0).r;\n"
+		"	int tile = int(info & " + TileMask + ");\n"
+		"	int palette = int((info >> " + PaletteShift + ") & " + PaletteMask + ");\n"
+		"	uint index = texelFetch(TILE_TABLE, 8 * ivec2(tile % 16, tile / 16) + px % 8, 0).r;\n"
+		"	fragColor = texelFetch(PALETTE_TABLE, ivec2(index, palette), 0);\n"
+		"}\n"
+	);
+
+	//look up the locations of uniforms:
+	BACKGROUND_POSITION_ivec2 = glGetUniformLocation(program, "BACKGROUND_POSITION");
+
+	//bind texture units indices to samplers:
+	gl_state.use_program(program);
+	glUniform1i(glGetUniformLocation(program, "TILE_TABLE"), 0);
+	glUniform1i(glGetUniformLocation(program, "PALETTE_TABLE"), 1);
+	glUniform1i(glGetUniformLocation(program, "BACKGROUND"), 2);
+	gl_state.use_program(0);
+
+	GL_ERRORS();
+}
+
+template< typename PPUType >
+PPUBackgroundProgram< PPUType >::~PPUBackgroundProgram() {
+	if (program != 0) {
+		glDeleteProgram(program);
+		program = 0;
+	}
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 
 //PPU data is streamed to the GPU (read: uploaded 'just in time') using a few buffers:
-PPUDataStream::PPUDataStream() {
+template< typename PPUType >
+PPUDataStream< PPUType >::PPUDataStream() {
 
 	//vertex_buffer_for_tile_program is a vertex array object that tells the GPU the layout of data in vertex_buffer:
 	glGenVertexArrays(1, &vertex_buffer_for_tile_program);
-	glBindVertexArray(vertex_buffer_for_tile_program);
+	gl_state.bind_vertex_array(vertex_buffer_for_tile_program);
 
 	//vertex_buffer will (eventually) hold vertex data for drawing:
 	glGenBuffers(1, &vertex_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	gl_state.bind_array_buffer(vertex_buffer);
+	vertex_stream.buffer = vertex_buffer;
 
 	//Notice how this binding is attaching an integer input to a floating point attribute:
 	glVertexAttribPointer(
@@ -396,43 +874,119 @@ PPUDataStream::PPUDataStream() {
 	);
 	glEnableVertexAttribArray(tile_program->Palette_int);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	gl_state.bind_array_buffer(0);
+
+	gl_state.bind_vertex_array(0);
+
+
+	//instance_buffer_for_instanced_tile_program does the same for instance_buffer,
+	// but advances its attributes once per instance rather than once per vertex:
+	glGenVertexArrays(1, &instance_buffer_for_instanced_tile_program);
+	gl_state.bind_vertex_array(instance_buffer_for_instanced_tile_program);
 
-	glBindVertexArray(0);
+	glGenBuffers(1, &instance_buffer);
+	gl_state.bind_array_buffer(instance_buffer);
+	instance_stream.buffer = instance_buffer;
+
+	point_instance_attributes(0);
+	glEnableVertexAttribArray(tile_program->InstancePosition_ivec2);
+	glVertexAttribDivisor(tile_program->InstancePosition_ivec2, 1);
+	glEnableVertexAttribArray(tile_program->InstanceTile_ivec2);
+	glVertexAttribDivisor(tile_program->InstanceTile_ivec2, 1);
+
+	gl_state.bind_array_buffer(0);
+
+	gl_state.bind_vertex_array(0);
+
+
+	//(core profile requires some vertex array object to be bound when drawing, even one without attributes)
+	glGenVertexArrays(1, &empty_vertex_array);
 
 
 	glGenTextures(1, &tile_tex);
-	glBindTexture(GL_TEXTURE_2D, tile_tex);
+	gl_state.bind_texture(tile_tex);
 	//passing 'nullptr' to TexImage says "allocate memory but don't store anything there":
 	// (textures will be uploaded later)
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, 128, 128, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, 128, 8 * TileRows, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
 	//make the texture have sharp pixels when magnified:
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	//when access past the edge, clamp to the edge:
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_state.bind_texture(0);
 
 
 	glGenTextures(1, &palette_tex);
-	glBindTexture(GL_TEXTURE_2D, palette_tex);
+	gl_state.bind_texture(palette_tex);
 	//passing 'nullptr' to TexImage says "allocate memory but don't store anything there":
 	// (textures will be uploaded later)
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 4, 8, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 4, PPUType::PaletteCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 	//make the texture have sharp pixels when magnified:
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	//when access past the edge, clamp to the edge:
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_state.bind_texture(0);
+
+
+	glGenTextures(1, &background_tex);
+	gl_state.bind_texture(background_tex);
+	//(uploaded later, like the others)
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, PPUType::BackgroundWidth, PPUType::BackgroundHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+	//integer textures must use nearest filtering:
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	gl_state.bind_texture(0);
+
+
+	glGenTextures(1, &native_tex);
+	gl_state.bind_texture(native_tex);
+	//(written by rendering, never uploaded)
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, PPUType::ScreenWidth, PPUType::ScreenHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	//sharp pixels for anyone who samples it (e.g., post-processing):
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	gl_state.bind_texture(0);
+
+	glGenFramebuffers(1, &native_fb);
+	gl_state.bind_framebuffer(GL_FRAMEBUFFER, native_fb);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, native_tex, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		throw std::runtime_error("PPU466 native-resolution framebuffer is incomplete.");
+	}
+	gl_state.bind_framebuffer(GL_FRAMEBUFFER, 0);
 
 
 	GL_ERRORS();
 }
 
-PPUDataStream::~PPUDataStream() {
+template< typename PPUType >
+void PPUDataStream< PPUType >::point_instance_attributes(size_t first_instance) const {
+	//(expects instance_buffer_for_instanced_tile_program and instance_buffer to be bound)
+	glVertexAttribIPointer(
+		tile_program->InstancePosition_ivec2, //attribute
+		2, //size
+		GL_SHORT, //type
+		sizeof(Instance), //stride
+		(GLbyte *)0 + first_instance * sizeof(Instance) + offsetof(Instance, Position) //offset
+	);
+	glVertexAttribIPointer(
+		tile_program->InstanceTile_ivec2, //attribute
+		2, //size
+		GL_UNSIGNED_SHORT, //type
+		sizeof(Instance), //stride
+		(GLbyte *)0 + first_instance * sizeof(Instance) + offsetof(Instance, Tile) //offset
+	);
+}
+
+template< typename PPUType >
+PPUDataStream< PPUType >::~PPUDataStream() {
 	if (vertex_buffer_for_tile_program != 0) {
 		glDeleteVertexArrays(1, &vertex_buffer_for_tile_program);
 		vertex_buffer_for_tile_program = 0;
@@ -441,6 +995,14 @@ PPUDataStream::~PPUDataStream() {
 		glDeleteBuffers(1, &vertex_buffer);
 		vertex_buffer = 0;
 	}
+	if (instance_buffer_for_instanced_tile_program != 0) {
+		glDeleteVertexArrays(1, &instance_buffer_for_instanced_tile_program);
+		instance_buffer_for_instanced_tile_program = 0;
+	}
+	if (instance_buffer != 0) {
+		glDeleteBuffers(1, &instance_buffer);
+		instance_buffer = 0;
+	}
 	if (tile_tex != 0) {
 		glDeleteTextures(1, &tile_tex);
 		tile_tex = 0;
@@ -449,4 +1011,97 @@ PPUDataStream::~PPUDataStream() {
 		glDeleteTextures(1, &palette_tex);
 		palette_tex = 0;
 	}
+	if (background_tex != 0) {
+		glDeleteTextures(1, &background_tex);
+		background_tex = 0;
+	}
+	if (empty_vertex_array != 0) {
+		glDeleteVertexArrays(1, &empty_vertex_array);
+		empty_vertex_array = 0;
+	}
+	if (native_fb != 0) {
+		glDeleteFramebuffers(1, &native_fb);
+		native_fb = 0;
+	}
+	if (native_tex != 0) {
+		glDeleteTextures(1, &native_tex);
+		native_tex = 0;
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PPUStreamRing::~PPUStreamRing() {
+	for (auto &fence : fences) {
+		if (fence) {
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+}
+
+size_t PPUStreamRing::upload(void const *data, size_t count, uint32_t *waits) {
+	gl_state.bind_array_buffer(buffer);
+	if (count == 0) return 0;
+
+	if (count > region_elements) {
+		//(re-)allocate the buffer with larger regions:
+		// the old storage is orphaned (the driver keeps it around until pending draws finish),
+		// so the old fences don't mean anything anymore.
+		region_elements = std::max(count, 2 * region_elements);
+		glBufferData(GL_ARRAY_BUFFER, RegionCount * region_elements * element_size, nullptr, GL_STREAM_DRAW);
+		for (auto &fence : fences) {
+			if (fence) {
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+		next_region = 0;
+	}
+
+	uint32_t region = next_region;
+	next_region = (next_region + 1) % RegionCount;
+	uploads += 1;
+
+	//make sure the GPU is done with this region's previous contents:
+	if (GLsync &fence = fences[region]) {
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			fence_waits += 1;
+			if (waits) *waits += 1;
+			do {
+				result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); //(timeout in nanoseconds)
+			} while (result == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	size_t const first = region * region_elements;
+	GLintptr const offset = GLintptr(first * element_size);
+	GLsizeiptr const size = GLsizeiptr(count * element_size);
+
+	void *mapped = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped) {
+		std::memcpy(mapped, data, size);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	} else {
+		//(mapping shouldn't fail, but if it does, this is still correct -- just maybe slower)
+		glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+	}
+
+	return first;
+}
+
+void PPUStreamRing::fence() {
+	//the region written by the most recent upload() is the one before next_region:
+	uint32_t region = (next_region + RegionCount - 1) % RegionCount;
+	if (fences[region]) glDeleteSync(fences[region]);
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 }
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+//the configurations declared in PPU466.hpp:
+template struct PPU< 64, 256, 8, 64, 60 >;
+template struct PPU< 256, 1024, 8, 64, 60 >;
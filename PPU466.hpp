@@ -3,24 +3,22 @@
 /*
  * PPU466 -- a very limited graphics system [loosely] based on the NES's PPU.
  *
+ * The capacities of the PPU (sprites, tiles, palettes, background size) are template
+ * parameters of PPU< ... >; PPU466 is the classic configuration, and PPU466Dense is a
+ * larger one for busier levels. Each configuration sizes its tables, buffers, textures,
+ * and shader constants at compile time, so the small one pays nothing for the big one.
+ * (A configuration's textures, buffers, and background shader are made by its first draw(),
+ *  so a program that never draws a PPU466Dense never allocates or compiles them.)
  */
 
 #include <glm/glm.hpp>
 #include <array>
+#include <bit>
+#include <type_traits>
+#include <vector>
 
-struct PPU466 {
-	PPU466();
-
-	//--------------------------------------------------------------
-	//Call these functions to draw with the PPU:
-
-	//when you wish the PPU to draw, tell it so:
-	// pass the size of the current framebuffer in pixels so it knows how to scale itself
-	void draw(glm::uvec2 const &drawable_size) const;
-
-	//--------------------------------------------------------------
-	//Set the values below to control the PPU's drawing:
-
+//Types and constants shared by every PPU configuration:
+struct PPUBase {
 	//The PPU's screen is 256x240:
 	// the origin -- pixel (0,0) -- is in the lower left
 	enum : uint32_t {
@@ -28,9 +26,30 @@ struct PPU466 {
 		ScreenHeight = 240
 	};
 
-	//Background Color:
-	// The PPU clears the screen to the background color before other drawing takes place.
-	glm::u8vec3 background_color = glm::u8vec3(0x00, 0x00, 0x00);
+	//draw() can feed tiles to the GPU in more than one way; all paths produce the same image:
+	enum class DrawPath : uint8_t {
+		TriangleStrip, //six 20-byte vertices per tile, built on the CPU
+		Instanced, //one 8-byte instance record per tile, expanded to a quad in the vertex shader
+		Tilemap, //background kept in a texture and drawn as one quad; sprites as in TriangleStrip
+	};
+
+	//per-call work + CPU time, broken down by stage:
+	// (GL calls are timed on the CPU side only; the GPU may do the actual work later)
+	struct DrawStats {
+		float build_ms = 0.0f; //building vertex / instance data
+		float decode_ms = 0.0f; //decoding tiles from bit planes
+		float upload_ms = 0.0f; //texture + buffer uploads
+		float submit_ms = 0.0f; //pipeline setup and draw calls
+		float raster_ms = 0.0f; //compositing pixels (render_to_buffer only)
+
+		uint32_t tiles_drawn = 0; //background tiles + sprites sent to the GPU (draw() only)
+		uint32_t background_tiles = 0; //background tiles that overlapped the screen and were sent (draw() only; 0 on the Tilemap path)
+		uint32_t tiles_decoded = 0; //tiles decoded (draw() only decodes changed tiles)
+		uint32_t fence_waits = 0; //times draw() had to wait for the GPU to free up a vertex stream region
+		uint32_t palette_uploads = 0; //1 if the palette table changed since the last draw() and was re-uploaded
+		uint32_t gl_state_changes = 0; //GL state changes made through gl_state (draw() only)
+		uint32_t gl_state_skipped = 0; //redundant GL state changes gl_state skipped (draw() only)
+	};
 
 	//Palette:
 	// The PPU uses 2-bit indexed color;
@@ -41,9 +60,30 @@ struct PPU466 {
 	//   color 0 to fully transparent (a = 0)
 	//   and color 1-3 to fully opaque (a = 0xff)
 
-	//Palette Table:
-	// The PPU stores 8 palettes for use when drawing tiles:
-	std::array< Palette, 8 > palette_table;
+	//Palette Animation:
+	// Animations registered with a PPU modify its palette_table each time animate_palettes() is called.
+	// Entries are addressed as if the palette table were one array of colors:
+	//  entry = 4 * palette index + color index
+	//
+	// A PaletteCycle rotates the colors in entries [first, first+count) one step
+	//  every 'frames_per_step' frames (the classic waterfall / glow effect):
+	struct PaletteCycle {
+		uint8_t first = 0; //first entry in the cycle
+		uint8_t count = 0; //number of entries in the cycle
+		uint16_t frames_per_step = 1; //frames between rotations
+		bool reverse = false; //rotate toward lower entries instead of higher
+		uint16_t timer = 0; //frames since the last rotation (updated by animate_palettes)
+	};
+	//
+	// A PaletteKeyframes replaces one whole palette with each of 'keys' in turn,
+	//  holding each for 'frames_per_key' frames (e.g., a damage flash):
+	struct PaletteKeyframes {
+		uint8_t palette = 0; //palette table index to write
+		std::vector< Palette > keys; //palettes to show, in order
+		uint16_t frames_per_key = 1; //frames to hold each key
+		bool loop = true; //if false, the last key stays in place once reached
+		uint32_t frame = 0; //frame of the animation to show next (updated by animate_palettes)
+	};
 
 	//Tile:
 	// The PPU uses 8x8 2-bit indexed-color tiles:
@@ -59,25 +99,92 @@ struct PPU466 {
 	struct Tile {
 		std::array< uint8_t, 8 > bit0; //<-- controls bit 0 of the color index
 		std::array< uint8_t, 8 > bit1; //<-- controls bit 1 of the color index
+		bool operator==(Tile const &) const = default;
 	};
 	static_assert(sizeof(Tile) == 16, "Tile is packed");
+};
+
+template< uint32_t SpriteCount_, uint32_t TileCount_, uint32_t PaletteCount_, uint32_t BackgroundWidth_, uint32_t BackgroundHeight_ >
+struct PPU : PPUBase {
+	//Capacities of this configuration:
+	static constexpr uint32_t SpriteCount = SpriteCount_;
+	static constexpr uint32_t TileCount = TileCount_;
+	static constexpr uint32_t PaletteCount = PaletteCount_;
+
+	//tiles are kept (and uploaded) as a grid 16 tiles wide:
+	static_assert(TileCount >= 16 && std::has_single_bit(TileCount), "tile count is a power of two, at least 16");
+	static_assert(PaletteCount >= 1 && PaletteCount <= 64 && std::has_single_bit(PaletteCount), "palette count is a power of two, at most 64");
+
+	//bits needed to store a tile index or a palette index:
+	static constexpr uint32_t TileIndexBits = uint32_t(std::bit_width(TileCount - 1));
+	static constexpr uint32_t PaletteIndexBits = uint32_t(std::bit_width(PaletteCount - 1));
+
+	PPU();
+
+	//--------------------------------------------------------------
+	//Call these functions to draw with the PPU:
+
+	//when you wish the PPU to draw, tell it so:
+	// pass the size of the current framebuffer in pixels so it knows how to scale itself
+	// (pass 'stats' to find out where the time went; see DrawStats in PPUBase)
+	void draw(glm::uvec2 const &drawable_size, DrawStats *stats = nullptr) const;
+
+	//(see DrawPath in PPUBase)
+	DrawPath draw_path = DrawPath::Tilemap;
+
+	//draw() renders at native resolution into an offscreen ScreenWidth x ScreenHeight
+	// RGBA8 texture, then blits that (with integer scaling) to the drawable.
+	//This is the GL name of that texture; it holds the most recent frame until the next
+	// draw(), which makes it handy for screen capture or post-processing:
+	uint32_t native_texture() const;
+
+	//to draw without a GPU, render the same image on the CPU instead:
+	// writes ScreenWidth x ScreenHeight pixels, rows from the bottom of the screen up
+	// (the same layout glReadPixels uses), matching what draw() puts in each PPU pixel.
+	// (defined in PPU466Software.cpp, which does not need an OpenGL context)
+	void render_to_buffer(std::array< glm::u8vec4, 256 * 240 > *pixels, DrawStats *stats = nullptr) const;
+
+	//--------------------------------------------------------------
+	//Set the values below to control the PPU's drawing:
+
+	//Background Color:
+	// The PPU clears the screen to the background color before other drawing takes place.
+	glm::u8vec3 background_color = glm::u8vec3(0x00, 0x00, 0x00);
+
+	//Palette Table:
+	// The PPU stores PaletteCount palettes (8 in PPU466) for use when drawing tiles:
+	std::array< Palette, PaletteCount > palette_table;
+	// (draw() only re-uploads the palette table when some entry changed, so
+	//  animating colors is much cheaper than animating tiles)
+
+	//Palette Animation (see PaletteCycle and PaletteKeyframes in PPUBase):
+	std::vector< PaletteCycle > palette_cycles;
+	std::vector< PaletteKeyframes > palette_keyframes;
+	//
+	// Advance all palette animations by 'frames' frames (call once per update):
+	// (cycles are applied first, then keyframes, each in registration order)
+	void animate_palettes(uint32_t frames = 1);
 
 	//Tile Table:
-	// The PPU has a 256-tile 'pattern memory' in which tiles are stored:
-	//  this is often thought of as a 16x16 grid of tiles.
-	std::array< Tile, 16 * 16 > tile_table;
+	// The PPU has a TileCount-tile 'pattern memory' in which tiles are stored:
+	//  this is often thought of as a grid of tiles, 16 tiles wide (16x16 in PPU466).
+	// (draw() keeps track of what it last sent to the GPU, so only tiles that
+	//  actually changed since the previous draw() cost any decoding or upload time)
+	std::array< Tile, TileCount > tile_table;
 
 	//Background Layer:
-	// The PPU's background layer is made of 64x60 tiles (512 x 480 pixels).
-	// This is twice the size of the screen, to support scrolling.
+	// The PPU's background layer is made of BackgroundWidth x BackgroundHeight tiles.
+	// In PPU466 it is 64x60 tiles (512 x 480 pixels), twice the size of the screen, to support scrolling.
 	enum : uint32_t {
-		BackgroundWidth = 64,
-		BackgroundHeight = 60
+		BackgroundWidth = BackgroundWidth_,
+		BackgroundHeight = BackgroundHeight_
 	};
+	static_assert(BackgroundWidth * 8 >= ScreenWidth && BackgroundHeight * 8 >= ScreenHeight, "background covers the screen");
 
 	// The background is stored as a row-major grid of 16-bit values:
 	//  the origin of the grid (tile (0,0)) is the bottom left of the grid
-	//  each value in the grid gives:
+	//  each value in the grid gives a tile table index in its low TileIndexBits bits,
+	//  with the palette table index just above it. In PPU466 that is:
 	//    - bits 0-7: tile table index
 	//    - bits 8-10: palette table index
 	//    - bits 11-15: unused, should be 0
@@ -87,8 +194,25 @@ struct PPU466 {
 	//            ^        ^        ^-- tile index
 	//            |        '----------- palette index
 	//            '-------------------- unused (set to zero)
+	static_assert(TileIndexBits + PaletteIndexBits <= 16, "tile and palette index fit in a background entry");
+	static constexpr uint32_t BackgroundPaletteShift = TileIndexBits;
+	static constexpr uint16_t BackgroundTileMask = uint16_t((1u << TileIndexBits) - 1);
+	static constexpr uint16_t BackgroundPaletteMask = uint16_t((1u << PaletteIndexBits) - 1);
 	std::array< uint16_t, BackgroundWidth * BackgroundHeight > background;
 
+	//Background change hint:
+	// bit y is set if row y of 'background' may have changed since the last draw().
+	// The Tilemap path only looks for changes (to upload) in marked rows. The contract:
+	//  - whatever writes 'background' sets the bits of the rows it wrote, OR-ing them in
+	//    (never clearing bits someone else set) -- see BackgroundLayer::apply and PPUPlayer;
+	//  - draw() consumes the hint: it checks the marked rows, then clears it (so it is mutable);
+	//  - if another PPU (or this one, on another draw path) updated the background texture
+	//    since this PPU's last Tilemap draw, draw() ignores the hint and checks every row.
+	// It starts at all-ones; code that writes 'background' without tracking rows should set
+	// it back to all-ones after each write.
+	static_assert(BackgroundHeight <= 64, "one hint bit per background row");
+	mutable uint64_t background_rows_changed = ~uint64_t(0);
+
 	//Background Position:
 	// The background's lower-left pixel can positioned anywhere
 	//   this can be used to "scroll the screen".
@@ -96,7 +220,7 @@ struct PPU466 {
 	//
 	// screen pixels "outside the background" wrap around to the other side.
 	// thus, background_position values of (x,y) and of (x+n*512,y+m*480) for
-	// any integers n,m will look the same
+	// any integers n,m will look the same (for PPU466's 512x480-pixel background)
 
 	//Sprite:
 	// On the PPU, all non-background objects are called 'sprites':
@@ -106,12 +230,13 @@ struct PPU466 {
 	//      ... y pixels from the bottom of the screen
 	//
 	//  the sprite index is an index into the tile table
+	//   (8 bits when there are at most 256 tiles, 16 bits otherwise)
 	//
 	//  the sprite 'attributes' byte gives:
 	//   bits:  7 6 5 4 3 2 1 0
 	//         |-|-------|-----|
 	//          ^    ^      ^
-	//          |    |      '---- palette index (bits 0-2)
+	//          |    |      '---- palette index (bits 0-2 in PPU466; PaletteIndexBits bits in general)
 	//          |    '----------- unused (set to zero)
 	//          '---------------- priority bit (bit 7)
 	//
@@ -119,21 +244,35 @@ struct PPU466 {
 	//   in front of (priority = 0) the background
 	//   or behind (priority = 1) the background
 	//
+	using TileIndex = std::conditional_t< (TileCount <= 256), uint8_t, uint16_t >;
 	struct Sprite {
 		uint8_t x = 0; //x position. 0 is the left edge of the screen.
 		uint8_t y = 240; //y position. 0 is the bottom edge of the screen. >= 240 is off-screen
-		uint8_t index = 0; //index into tile table
+		TileIndex index = 0; //index into tile table
 		uint8_t attributes = 0; //tile attribute bits
+		//(compares fields -- with 16-bit tile indices the struct has a padding byte, so don't memcmp it)
+		bool operator==(Sprite const &) const = default;
 	};
-	static_assert(sizeof(Sprite) == 4, "Sprite is a 32-bit value.");
+	static_assert(TileCount > 256 || sizeof(Sprite) == 4, "Sprite is a 32-bit value.");
+	static constexpr uint8_t SpritePaletteMask = uint8_t((1u << PaletteIndexBits) - 1);
 	//
 	// The observant among you will notice that you can't draw a sprite moving off the left
 	//  or bottom edges of the screen. Yep! This is [similar to] a limitation of the NES PPU!
 
 
 	//Sprites:
-	// The PPU always draws exactly 64 sprites:
+	// The PPU always draws exactly SpriteCount sprites (64 in PPU466):
 	//  any sprites you don't want to use should be moved off the screen (y >= 240)
-	std::array< Sprite, 64 > sprites;
+	std::array< Sprite, SpriteCount > sprites;
 
 };
+
+//The classic configuration -- 64 sprites, 256 tiles, 8 palettes, 64x60 background:
+using PPU466 = PPU< 64, 256, 8, 64, 60 >;
+
+//A denser configuration for busier levels -- 256 sprites, 1024 tiles:
+using PPU466Dense = PPU< 256, 1024, 8, 64, 60 >;
+
+//(both configurations are compiled once, in PPU466.cpp and PPU466Software.cpp)
+extern template struct PPU< 64, 256, 8, 64, 60 >;
+extern template struct PPU< 256, 1024, 8, 64, 60 >;
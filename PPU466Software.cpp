@@ -0,0 +1,129 @@
+#include "PPU466.hpp"
+#include "bitplanes.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+//Software rasterizer for the PPU466:
+// produces the same pixels as PPU466::draw(), but on the CPU, one scanline at a time.
+//
+// draw() composites (in order) the background color, the 'behind' sprites, the background,
+// and the 'in front' sprites, using (SRC_ALPHA, ONE_MINUS_SRC_ALPHA) blending into an
+// 8-bit-per-channel framebuffer; this code does exactly the same, with the blend done in
+// integer math that rounds the way the framebuffer conversion does.
+
+namespace {
+
+//blend 'src' over 'dst' the way glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) does:
+inline void blend(glm::u8vec4 const &src, glm::u8vec4 *dst_) {
+	glm::u8vec4 &dst = *dst_;
+	uint32_t a = src.a;
+	if (a == 0xff) {
+		//fully opaque (the common case): just copy
+		dst = src;
+		return;
+	}
+	if (a == 0x00) return; //fully transparent: nothing to do
+
+	//round(s * a/255 + d * (255-a)/255) for each channel (including alpha):
+	auto mix = [a](uint32_t s, uint32_t d) -> uint8_t {
+		return uint8_t((s * a + d * (255 - a) + 127) / 255);
+	};
+	dst = glm::u8vec4(
+		mix(src.r, dst.r),
+		mix(src.g, dst.g),
+		mix(src.b, dst.b),
+		mix(src.a, dst.a)
+	);
+}
+
+}
+
+template< uint32_t S, uint32_t T, uint32_t P, uint32_t W, uint32_t H >
+void PPU< S, T, P, W, H >::render_to_buffer(std::array< glm::u8vec4, 256 * 240 > *pixels_, DrawStats *stats) const {
+	static_assert(ScreenWidth == 256 && ScreenHeight == 240, "render_to_buffer's buffer is screen-sized");
+	assert(pixels_);
+	auto &pixels = *pixels_;
+
+	auto before = std::chrono::high_resolution_clock::now();
+
+	//decode every tile to one color index per pixel, 8x8 tiles stored consecutively:
+	// (this is the same interpretation draw() uses when building its tile texture)
+	std::array< uint8_t, TileCount * 64 > indices;
+	decode_tiles(tile_table.data(), tile_table.size(), indices.data());
+
+	auto after_decode = std::chrono::high_resolution_clock::now();
+
+	//the background is drawn with wrap-around; reduce its position to [0,W) x [0,H) pixels:
+	constexpr int32_t BackgroundWidthPixels = int32_t(BackgroundWidth) * 8;
+	constexpr int32_t BackgroundHeightPixels = int32_t(BackgroundHeight) * 8;
+	glm::ivec2 pos = background_position;
+	pos.x = ((pos.x % BackgroundWidthPixels) + BackgroundWidthPixels) % BackgroundWidthPixels;
+	pos.y = ((pos.y % BackgroundHeightPixels) + BackgroundHeightPixels) % BackgroundHeightPixels;
+
+	//draw() clears to the background color with alpha 1.0:
+	glm::u8vec4 const clear = glm::u8vec4(background_color.r, background_color.g, background_color.b, 0xff);
+
+	for (uint32_t y = 0; y < ScreenHeight; ++y) {
+		glm::u8vec4 *row = &pixels[ScreenWidth * y];
+
+		for (uint32_t x = 0; x < ScreenWidth; ++x) {
+			row[x] = clear;
+		}
+
+		//helper to draw the part of each sprite (with a given priority) that covers this scanline:
+		auto draw_sprites = [&,this](uint8_t priority) {
+			for (auto const &sprite : sprites) {
+				if ((sprite.attributes & 0x80) != priority) continue;
+				if (y < sprite.y || y >= uint32_t(sprite.y) + 8) continue;
+				Palette const &palette = palette_table[sprite.attributes & SpritePaletteMask];
+				uint8_t const *tile_row = &indices[sprite.index * 64 + 8 * (y - sprite.y)];
+				//(sprites can hang off the right edge of the screen)
+				uint32_t count = std::min(8U, ScreenWidth - sprite.x);
+				for (uint32_t i = 0; i < count; ++i) {
+					blend(palette[tile_row[i]], &row[sprite.x + i]);
+				}
+			}
+		};
+
+		draw_sprites(0x80); //sprites with priority == 1 ('behind' sprites)
+
+		{ //background:
+			//background pixel row under this scanline:
+			uint32_t by = (y + BackgroundHeightPixels - pos.y) % BackgroundHeightPixels;
+			uint16_t const *background_row = &background[BackgroundWidth * (by / 8)];
+			uint32_t const fine_y = by % 8;
+
+			//walk the scanline a tile (or part of a tile) at a time:
+			uint32_t bx = (BackgroundWidthPixels - pos.x) % BackgroundWidthPixels;
+			for (uint32_t x = 0; x < ScreenWidth; ) {
+				uint16_t info = background_row[bx / 8];
+				Palette const &palette = palette_table[(info >> BackgroundPaletteShift) & BackgroundPaletteMask];
+				uint8_t const *tile_row = &indices[(info & BackgroundTileMask) * 64 + 8 * fine_y];
+
+				uint32_t fine_x = bx % 8;
+				uint32_t count = std::min(8 - fine_x, ScreenWidth - x);
+				for (uint32_t i = 0; i < count; ++i) {
+					blend(palette[tile_row[fine_x + i]], &row[x + i]);
+				}
+				x += count;
+				bx = (bx + count) % BackgroundWidthPixels;
+			}
+		}
+
+		draw_sprites(0x00); //sprites with priority == 0 ('in front' sprites)
+	}
+
+	if (stats) {
+		auto after_raster = std::chrono::high_resolution_clock::now();
+		*stats = DrawStats();
+		stats->decode_ms = std::chrono::duration< float, std::milli >(after_decode - before).count();
+		stats->raster_ms = std::chrono::duration< float, std::milli >(after_raster - after_decode).count();
+		stats->tiles_decoded = uint32_t(tile_table.size());
+	}
+}
+
+//(the rest of each configuration is instantiated in PPU466.cpp)
+template void PPU< 64, 256, 8, 64, 60 >::render_to_buffer(std::array< glm::u8vec4, 256 * 240 > *, DrawStats *) const;
+template void PPU< 256, 1024, 8, 64, 60 >::render_to_buffer(std::array< glm::u8vec4, 256 * 240 > *, DrawStats *) const;
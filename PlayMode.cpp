@@ -1,5 +1,7 @@
 #include "PlayMode.hpp"
 #include "AssetLoader.hpp"
+#include "bitplanes.hpp"
+#include "data_path.hpp"
 
 //for the GL_ERRORS() macro:
 #include "gl_errors.hpp"
@@ -7,12 +9,36 @@
 //for glm::value_ptr() :
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <random>
 
-PlayMode::PlayMode() {
+PlayData PlayData::load(std::string const &level_file) {
+	PlayData data;
+	data.tiles_loaded = AssetLoader::load_assets("game1_tileset.dat", data.tile_table, data.palette_table);
+	
+	// (compiled from levels/*.txt by build_level)
+	auto world = std::make_shared< WorldMap >();
+	try {
+		read_level(data_path(level_file), &data.level, world.get());
+	} catch (std::exception const &e) {
+		std::cerr << "Failed to load level: " << e.what() << std::endl;
+		compile_level_text({}, &data.level, world.get());
+	}
+	data.world = world;
+	return data;
+}
+
+PlayMode::PlayMode() : PlayMode(PlayData::load()) {
+}
+
+PlayMode::PlayMode(PlayData const &data) {
 	
-	// Load assets first
-	if (AssetLoader::load_assets("game1_tileset.dat", ppu.tile_table, ppu.palette_table)) {
+	// Copy in the loaded assets first
+	if (data.tiles_loaded) {
+		ppu.tile_table = data.tile_table;
+		ppu.palette_table = data.palette_table;
 		
 		// Create game sprites
 		create_game_sprites();
@@ -27,14 +53,65 @@ PlayMode::PlayMode() {
 	player_animator.set_sprite(sprites.lookup("player"));
 	player_animator.frame_time = 0.2f;  // 5 FPS animation
 	
-	// Create level elements using ASCII map
-	load_level_from_map(get_level_map());
+	// Start the level
+	level = data.level;
+	world = data.world;
+	start_level();
 }
 
 PlayMode::~PlayMode() {
 }
 
+void PlayMode::start_recording(std::string const &filename) {
+	recording_file.open(filename, std::ios::binary);
+	if (!recording_file) {
+		throw std::runtime_error("Failed to open '" + filename + "' to record PPU frames.");
+	}
+	recorder = std::make_unique< PPURecorder< PPU466 > >(&recording_file);
+}
+
+void PlayMode::start_input_recording() {
+	input_recording = std::make_unique< InputRecording >();
+}
+
+void PlayMode::save_input_recording(std::string const &filename) {
+	assert(input_recording);
+	input_recording->header.ticks = tick;
+	input_recording->header.state_hash = state_hash();
+	write_input_recording(filename, *input_recording);
+}
+
+void PlayMode::start_replay(InputRecording const &recording) {
+	replay = std::make_unique< InputRecording >(recording);
+	replay_next = 0;
+}
+
+uint64_t PlayMode::state_hash() const {
+	//FNV-1a over the bytes of everything the simulation moves or changes:
+	uint64_t hash = 0xcbf29ce484222325ull;
+	auto add = [&hash](void const *data, size_t size) {
+		for (size_t i = 0; i < size; ++i) {
+			hash = (hash ^ reinterpret_cast< uint8_t const * >(data)[i]) * 0x100000001b3ull;
+		}
+	};
+	add(&player_at, sizeof(player_at));
+	add(&player_health, sizeof(player_health));
+	add(&hits_taken, sizeof(hits_taken));
+	add(&flowers_grown, sizeof(flowers_grown));
+	add(&invulnerability_timer, sizeof(invulnerability_timer));
+	add(&game_over, sizeof(game_over));
+	add(enemies.phase.data(), enemies.phase.size() * sizeof(float));
+	add(enemies.active.data(), enemies.active.size());
+	for (auto const &collectible : collectibles) {
+		add(&collectible.collected, sizeof(collectible.collected));
+	}
+	return hash;
+}
+
 bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
+	// During a replay, input comes from the recording only
+	if (replay) return false;
+
 
 	if (evt.type == SDL_EVENT_KEY_DOWN) {
 		if (evt.key.key == SDLK_LEFT) {
@@ -61,6 +138,7 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 			// Restart game when 'R' is pressed during game over
 			if (game_over) {
 				restart_game();
+				restarted = true;
 				return true;
 			}
 		}
@@ -87,10 +165,47 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 }
 
 void PlayMode::update(float elapsed) {
+	// Take input from the replay, or note it in the recording
+	if (replay) {
+		InputTick input = replay->at(tick, &replay_next);
+		if (input.flags & InputTick::Restart) restart_game();
+		auto set = [&input](Button *button, uint8_t bit) {
+			button->pressed = (input.pressed & bit) ? 1 : 0;
+			button->downs = (input.downs & bit) ? 1 : 0;
+		};
+		set(&left, InputButtons::Left);
+		set(&right, InputButtons::Right);
+		set(&up, InputButtons::Up);
+		set(&down, InputButtons::Down);
+		set(&action, InputButtons::Action);
+	} else if (input_recording) {
+		InputTick input;
+		input.tick = tick;
+		auto note = [&input](Button const &button, uint8_t bit) {
+			if (button.pressed) input.pressed |= bit;
+			if (button.downs) input.downs |= bit;
+		};
+		note(left, InputButtons::Left);
+		note(right, InputButtons::Right);
+		note(up, InputButtons::Up);
+		note(down, InputButtons::Down);
+		note(action, InputButtons::Action);
+		if (restarted) input.flags |= InputTick::Restart;
+		input_recording->add(input);
+		input_recording->header.tick_elapsed = elapsed;
+	}
+	restarted = false;
+	tick += 1;
+
+	// Remember where things were, so draw can blend between ticks
+	player_previous_at = player_at;
+	tick_elapsed = 0.0f;
+
 	// Don't update game logic during game over
 	if (game_over) {
 		return;
 	}
+	tick_elapsed = elapsed;
 	
 	// Player movement
 	constexpr float PlayerSpeed = 60.0f;
@@ -122,48 +237,24 @@ void PlayMode::update(float elapsed) {
 	// Keep bee animation always playing (flying in place)
 	player_animator.play();
 	
-	// Keep player on screen
-	player_at.x = std::max(4.0f, std::min(252.0f, player_at.x));
-	player_at.y = std::max(4.0f, std::min(236.0f, player_at.y));
+	// Keep player in the world
+	player_at.x = std::max(4.0f, std::min(float(world->width * 8) - 4.0f, player_at.x));
+	player_at.y = std::max(4.0f, std::min(float(world->height * 8) - 4.0f, player_at.y));
 	
 	// Update player animation
 	player_animator.update(elapsed);
 	
-	// Update enemies
-	for (auto &enemy : enemies) {
-		if (!enemy.active) continue;
-		
-		// Update enemy movement if they have a path
-		if (enemy.path_distance > 0.0f) {
-			float move_speed = 30.0f; // pixels per second
-			float distance_this_frame = move_speed * elapsed;
-			
-			if (enemy.moving_forward) {
-				enemy.current_distance += distance_this_frame;
-				enemy.position += enemy.move_direction * distance_this_frame;
-				
-				// Check if reached end of path
-				if (enemy.current_distance >= enemy.path_distance) {
-					enemy.moving_forward = false;
-					enemy.current_distance = enemy.path_distance;
-					enemy.position = enemy.start_position + enemy.move_direction * enemy.path_distance;
-				}
-			} else {
-				enemy.current_distance -= distance_this_frame;
-				enemy.position -= enemy.move_direction * distance_this_frame;
-				
-				// Check if reached start of path
-				if (enemy.current_distance <= 0.0f) {
-					enemy.moving_forward = true;
-					enemy.current_distance = 0.0f;
-					enemy.position = enemy.start_position;
-				}
-			}
-		}
-		
-		// Update enemy animation
-		enemy.animator.update(elapsed);
+	// Update enemies (all of them at once -- see patrol.hpp)
+	enemies.step(elapsed);
+	enemy_animator.update(elapsed);
+
+	// Index active enemies by position for collision checks
+	enemy_grid.clear();
+	enemy_grid.set_origin(player_at - glm::vec2(PPU466::BackgroundWidth * 4, PPU466::BackgroundHeight * 4));
+	for (uint32_t i = 0; i < enemies.size(); ++i) {
+		if (enemies.active[i]) enemy_grid.insert(i, enemies.position(i));
 	}
+	enemy_grid.build();
 	
 	// Update invulnerability timer
 	if (invulnerability_timer > 0.0f) {
@@ -186,68 +277,88 @@ void PlayMode::update(float elapsed) {
 	action.downs = 0;
 }
 
-void PlayMode::draw(glm::uvec2 const &drawable_size) {
-	ppu.background_color = glm::u8vec4(0x10, 0x20, 0x30, 0xff);
+void PlayMode::draw(glm::uvec2 const &drawable_size, float alpha) {
+	// Bring the PPU up to date with the game state
+	update_ppu(alpha);
 	
-	// Create background tilemap
-	create_level_background();
+	//--- actually draw ---
+	if (recorder) recorder->record(ppu);
+	ppu.draw(drawable_size);
+}
+
+void PlayMode::update_ppu(float alpha) {
+	ppu.background_color = glm::u8vec4(0x10, 0x20, 0x30, 0xff);
 	
-	// Add wood tiles on top of background pattern
-	update_background_with_wood();
+	// Follow the player, scrolling the background ring; newly exposed tiles are copied in from the world
+	glm::vec2 player_drawn = player_previous_at + (player_at - player_previous_at) * alpha;
+	camera = camera_for(player_drawn);
+	ppu.background_position = -camera;
+	tiles_streamed = background_streamer.stream(*world, glm::ivec2(camera.x / 8, camera.y / 8), &background_layer);
 	
-	// No background scrolling
-	ppu.background_position.x = 0;
-	ppu.background_position.y = 0;
+	// Sprites go on screen relative to the camera, and are skipped when off it
+	//  (the PPU can't show sprites partly past the left or bottom edge anyway)
+	auto on_screen = [](int32_t x, int32_t y) {
+		return x >= 0 && x < int32_t(PPU466::ScreenWidth) && y >= 0 && y < int32_t(PPU466::ScreenHeight);
+	};
 	
-	// Clear all hardware sprites first
-	for (auto &sprite : ppu.sprites) {
-		sprite.y = 240; // Move off-screen
-	}
-	next_sprite_slot = 0;  // Reset sprite allocation
+	// Gather this frame's sprites (the multiplexer assigns hardware slots below)
+	sprite_multiplexer.clear();
 	
 	// Draw player with animation
 	if (const Sprite *player_sprite = sprites.lookup("player")) {
-		uint32_t slot = allocate_sprite_slots(player_sprite->get_sprite_count());
-		player_sprite->draw_frame(ppu, int32_t(player_at.x), int32_t(player_at.y), slot, player_animator.get_current_frame(), player_facing_right);
+		sprite_multiplexer.add(player_sprite, int32_t(player_drawn.x) - camera.x, int32_t(player_drawn.y) - camera.y, player_animator.get_current_frame(), player_facing_right, PlayerPriority);
 	}
 	
 	// Draw enemies with animation
-	for (const auto &enemy : enemies) {
-		if (!enemy.active) continue;
-		
-		if (const Sprite *enemy_sprite = sprites.lookup("enemy")) {
-			uint32_t slot = allocate_sprite_slots(enemy_sprite->get_sprite_count());
-			enemy_sprite->draw_frame(ppu, int32_t(enemy.position.x), int32_t(enemy.position.y), slot, enemy.animator.get_current_frame());
+	if (const Sprite *enemy_sprite = sprites.lookup("enemy")) {
+		for (uint32_t i = 0; i < enemies.size(); ++i) {
+			if (!enemies.active[i]) continue;
+			glm::vec2 at = enemies.position_at(i, (alpha - 1.0f) * tick_elapsed); //(between the last two ticks)
+			int32_t x = int32_t(at.x) - camera.x;
+			int32_t y = int32_t(at.y) - camera.y;
+			if (!on_screen(x, y)) continue;
+			sprite_multiplexer.add(enemy_sprite, x, y, enemy_animator.get_current_frame(), false, EnemyPriority);
 		}
 	}
 	
 	// Draw collectibles
 	for (const auto &collectible : collectibles) {
 		if (collectible.collected) continue;
+		int32_t x = int32_t(collectible.position.x) - camera.x;
+		int32_t y = int32_t(collectible.position.y) - camera.y;
+		if (!on_screen(x, y)) continue;
 		
 		if (const Sprite *item_sprite = sprites.lookup(collectible.type)) {
-			uint32_t slot = allocate_sprite_slots(item_sprite->get_sprite_count());
-			item_sprite->draw(ppu, int32_t(collectible.position.x), int32_t(collectible.position.y), slot);
+			sprite_multiplexer.add(item_sprite, x, y, 0, false, CollectiblePriority);
 		}
 	}
 	
 	// Draw health display in top-right corner
 	if (const Sprite *heart_sprite = sprites.lookup("heart")) {
 		for (int i = 0; i < player_health; ++i) {
-			uint32_t slot = allocate_sprite_slots(heart_sprite->get_sprite_count());
 			int32_t heart_x = 248 - (i * 12) - 8; // Start from right side and move left
 			int32_t heart_y = 232;
-			heart_sprite->draw(ppu, heart_x, heart_y, slot);
+			sprite_multiplexer.add(heart_sprite, heart_x, heart_y, 0, false, HealthPriority);
 		}
 	}
 	
+	// Pack into hardware sprites (crowded priority levels take turns across frames)
+	uint32_t dropped = sprite_multiplexer.pack(&ppu);
+	if (dropped != reported_dropped && verbose) {
+		std::cerr << "Note: " << dropped << " of " << sprite_multiplexer.requested << " sprites didn't fit this frame"
+			<< (dropped ? " (they flicker)." : ".") << std::endl;
+		reported_dropped = dropped;
+	}
+	
 	// Draw game over screen
 	if (game_over) {
 		draw_game_over_screen();
+	} else {
+		background_layer.clear_overlays();
 	}
 	
-	//--- actually draw ---
-	ppu.draw(drawable_size);
+	// Copy changed background rows to the PPU (which then only uploads those)
+	background_layer.apply(&ppu);
 }
 
 void PlayMode::create_game_sprites() {
@@ -279,85 +390,15 @@ void PlayMode::create_game_sprites() {
 }
 
 void PlayMode::spawn_enemy(glm::vec2 position) {
-	Enemy enemy;
-	enemy.position = position;
-	enemy.start_position = position;
-	enemy.velocity = glm::vec2(0.0f, 0.0f);  // Stationary enemies
-	enemy.move_direction = glm::vec2(0.0f, 0.0f);
-	enemy.path_distance = 0.0f;
-	enemy.current_distance = 0.0f;
-	enemy.moving_forward = true;
-	enemy.animator.set_sprite(sprites.lookup("enemy"));
-	enemy.animator.frame_time = 0.3f;
-	enemies.push_back(enemy);
+	enemies.add(position, glm::vec2(0.0f, 0.0f), 0.0f);  // Stationary enemies
 }
 
 void PlayMode::spawn_enemy_with_direction(glm::vec2 position, glm::vec2 direction, float distance) {
-	Enemy enemy;
-	enemy.position = position;
-	enemy.start_position = position;
-	enemy.velocity = glm::normalize(direction) * 30.0f;  // 30 pixels per second
-	enemy.move_direction = glm::normalize(direction);
-	enemy.path_distance = distance;
-	enemy.current_distance = 0.0f;
-	enemy.moving_forward = true;
-	enemy.animator.set_sprite(sprites.lookup("enemy"));
-	enemy.animator.frame_time = 0.3f;
-	enemies.push_back(enemy);
-}
-
-uint32_t PlayMode::allocate_sprite_slots(uint32_t count) {
-	if (next_sprite_slot + count > ppu.sprites.size()) {
-		std::cerr << "Warning: Out of sprite slots!" << std::endl;
-		return 0;
-	}
-	uint32_t slot = next_sprite_slot;
-	next_sprite_slot += count;
-	return slot;
-}
-
-void PlayMode::create_level_background() {
-	uint32_t window_pattern[4][4] = {
-		{ 4,  5,  6,  7},
-		{20, 21, 22, 23},
-		{36, 37, 38, 39},
-		{52, 53, 54, 55}
-	};
-	
-	for (uint32_t y = 0; y < PPU466::BackgroundHeight; ++y) {
-		for (uint32_t x = 0; x < PPU466::BackgroundWidth; ++x) {
-			uint32_t bg_index = x + y * PPU466::BackgroundWidth;
-			
-			uint32_t pattern_x = x % 4;
-			uint32_t pattern_y = y % 4;
-			
-			uint32_t tile_index = window_pattern[pattern_y][pattern_x];
-			uint32_t palette_index = 1;
-			
-			if (bg_index < ppu.background.size()) {
-				ppu.background[bg_index] = tile_index | (palette_index << 8);
-			}
-		}
-	}
+	enemies.add(position, direction, distance);  // (moves at enemies.speed, 30 pixels per second)
 }
 
 
 
-void PlayMode::update_background_with_wood() {
-	// Place wood tiles in the background
-	for (const auto &wood_pos : wood_tile_positions) {
-		if (wood_pos.x >= 0 && wood_pos.x < (int)PPU466::BackgroundWidth &&
-		    wood_pos.y >= 0 && wood_pos.y < (int)PPU466::BackgroundHeight) {
-			
-			uint32_t bg_index = wood_pos.x + wood_pos.y * PPU466::BackgroundWidth;
-			if (bg_index < ppu.background.size()) {
-				// tile 24 (wood tile) with palette 4
-				ppu.background[bg_index] = 24 | (4 << 8);
-			}
-		}
-	}
-}
-
 bool PlayMode::check_collision(glm::vec2 position, glm::vec2 size) {
 	int left_tile = int(position.x / 8.0f);
 	int right_tile = int((position.x + size.x - 1) / 8.0f);
@@ -365,72 +406,50 @@ bool PlayMode::check_collision(glm::vec2 position, glm::vec2 size) {
 	int top_tile = int((position.y + size.y - 1) / 8.0f);
 	
 	// Check if any of the tiles the sprite overlaps contain wood
-	for (int y = bottom_tile; y <= top_tile; ++y) {
-		for (int x = left_tile; x <= right_tile; ++x) {
-			// Check if this tile position contains wood
-			for (const auto &wood_pos : wood_tile_positions) {
-				if (wood_pos.x == x && wood_pos.y == y) {
-					return true;  // Collision detected
-				}
-			}
-		}
-	}
-	return false;
+	return world->any_solid(left_tile, bottom_tile, right_tile, top_tile);
+}
+
+glm::ivec2 PlayMode::camera_for(glm::vec2 const &player) const {
+	// Center the (16x16) player on the screen...
+	glm::ivec2 at = glm::ivec2(int32_t(std::floor(player.x)) + 8 - int32_t(PPU466::ScreenWidth) / 2, int32_t(std::floor(player.y)) + 8 - int32_t(PPU466::ScreenHeight) / 2);
+	// ...unless that would show past the world's edge
+	at.x = std::clamp(at.x, 0, std::max(0, int32_t(world->width * 8) - int32_t(PPU466::ScreenWidth)));
+	at.y = std::clamp(at.y, 0, std::max(0, int32_t(world->height * 8) - int32_t(PPU466::ScreenHeight)));
+	return at;
 }
 
-void PlayMode::load_level_from_map(const std::vector<std::string> &level_map) {
-	wood_tile_positions.clear();
+void PlayMode::start_level() {
+	// Everything comes straight from the compiled level -- no parsing
+	// (the world map is read in place; the background ring is refilled around the camera on the next draw)
+	background_streamer.reset();
+	
 	enemies.clear();
+	enemy_animator.set_sprite(sprites.lookup("enemy"));
+	enemy_animator.frame_time = 0.3f;
 	collectibles.clear();
 	
-	
-	// Map coordinates: top-left is (0,0), but PPU466 uses bottom-left origin
-	int map_height = level_map.size();
-	
-	for (int row = 0; row < map_height; ++row) {
-		if (row >= (int)level_map.size()) break;
-		
-		const std::string &line = level_map[row];
-		for (int col = 0; col < (int)line.length(); ++col) {
-			char c = line[col];
-			
-			// Convert map coordinates to screen coordinates and tile coordinates
-			float pixel_x = col * 8.0f;
-			float pixel_y = (map_height - 1 - row) * 8.0f;
-			int tile_x = col;
-			int tile_y = map_height - 1 - row;
-			
-			switch (c) {
-				case '#': // Wood block - now stored as background tile position
-					wood_tile_positions.push_back({tile_x, tile_y});
-					break;
-				case 'E': // Enemy - stationary
-					spawn_enemy(glm::vec2(pixel_x, pixel_y));
-					break;
-				case 'L': // Enemy - moves left/right
-					spawn_enemy_with_direction(glm::vec2(pixel_x, pixel_y), glm::vec2(1.0f, 0.0f), 32.0f);
-					break;
-				case 'U': // Enemy - moves up/down  
-					spawn_enemy_with_direction(glm::vec2(pixel_x, pixel_y), glm::vec2(0.0f, 1.0f), 24.0f);
-					break;
-				case 'H': // Heart
-					collectibles.push_back({{pixel_x, pixel_y}, "heart", false});
-					break;
-				case 'P': // Pot
-					collectibles.push_back({{pixel_x, pixel_y}, "pot", false});
-					break;
-				case 'F': // Flower
-					collectibles.push_back({{pixel_x, pixel_y}, "flower", false});
-					break;
-				case '.': // Empty space
-				case ' ': // Empty space
-				default:
-					break;
-			}
+	for (uint32_t i = 0; i < level.spawn_count; ++i) {
+		const LevelSpawn &spawn = level.spawns[i];
+		glm::vec2 position = glm::vec2(spawn.x, spawn.y);
+		switch (spawn.kind) {
+			case LevelSpawn::Enemy:
+				if (spawn.length > 0) {
+					spawn_enemy_with_direction(position, glm::vec2(spawn.dx, spawn.dy), float(spawn.length));
+				} else {
+					spawn_enemy(position);
+				}
+				break;
+			case LevelSpawn::Heart:
+				collectibles.push_back({position, "heart", false});
+				break;
+			case LevelSpawn::Pot:
+				collectibles.push_back({position, "pot", false});
+				break;
+			case LevelSpawn::Flower:
+				collectibles.push_back({position, "flower", false});
+				break;
 		}
 	}
-	
-	update_background_with_wood();
 }
 
 void PlayMode::check_enemy_collisions() {
@@ -438,25 +457,24 @@ void PlayMode::check_enemy_collisions() {
 	
 	const float collision_distance = 8.0f; // TODO: change if needed
 	
-	for (const auto &enemy : enemies) {
-		if (!enemy.active) continue;
-		
-		// Calculate distance between player and enemy
-		float distance = glm::length(player_at - enemy.position);
+	// Look for any active enemy within collision distance of the player
+	bool hit = false;
+	enemy_grid.for_each_within(player_at, collision_distance, [&hit](uint32_t, glm::vec2 const &) {
+		hit = true;
+		return true; // Only take damage from one enemy per frame
+	});
+	
+	if (hit) {
+		// Player hit by enemy - take damage
+		player_health--;
+		hits_taken += 1;
+		invulnerability_timer = 1.0f; // 1 second of invulnerability
 		
-		if (distance <= collision_distance) {
-			// Player hit by enemy - take damage
-			player_health--;
-			invulnerability_timer = 1.0f; // 1 second of invulnerability
-			
-			// Check for game over
-			if (player_health <= 0) {
-				std::cout << "Game Over! Press R to restart." << std::endl;
-				player_health = 0; // Prevent negative health
-				game_over = true;  // Enter game over state
-			}
-			
-			break; // Only take damage from one enemy per frame
+		// Check for game over
+		if (player_health <= 0) {
+			if (verbose) std::cout << "Game Over! Press R to restart." << std::endl;
+			player_health = 0; // Prevent negative health
+			game_over = true;  // Enter game over state
 		}
 	}
 }
@@ -465,34 +483,41 @@ void PlayMode::check_pot_interaction() {
 	// Check if player is near any pot
 	const float interaction_distance = 16.0f;  // Player can interact within 16 pixels
 	
-	for (auto &collectible : collectibles) {
-		if (collectible.type == "pot" && !collectible.collected) {
-			// Calculate distance between player and pot
-			float distance = glm::length(player_at - collectible.position);
-			
-			if (distance <= interaction_distance) {
-				// Player is near this pot - spawn a flower above it
-				glm::vec2 flower_position = collectible.position + glm::vec2(0.0f, 7.0f);  // 7 pixels above pot
-				
-				// Check if there's already a flower at this position
-				bool flower_exists = false;
-				for (const auto &item : collectibles) {
-					if (item.type == "flower" && 
-					    glm::length(item.position - flower_position) < 4.0f) {
-						flower_exists = true;
-						break;
-					}
-				}
-				
-				// Only spawn flower if one doesn't already exist here
-				if (!flower_exists) {
-					collectibles.push_back({flower_position, "flower", false});
-				}
-				
-				// Only interact with the closest pot
-				break;
-			}
+	// Index collectibles by position (only needed when the player interacts)
+	collectible_grid.clear();
+	collectible_grid.set_origin(player_at - glm::vec2(PPU466::BackgroundWidth * 4, PPU466::BackgroundHeight * 4));
+	for (uint32_t i = 0; i < collectibles.size(); ++i) {
+		collectible_grid.insert(i, collectibles[i].position);
+	}
+	collectible_grid.build();
+	
+	// Find the first uncollected pot (in level order) near the player
+	uint32_t pot = uint32_t(collectibles.size());
+	collectible_grid.for_each_within(player_at, interaction_distance, [&](uint32_t id, glm::vec2 const &) {
+		const auto &collectible = collectibles[id];
+		if (collectible.type == "pot" && !collectible.collected) pot = std::min(pot, id);
+		return false;
+	});
+	if (pot == collectibles.size()) return;
+	
+	// Player is near this pot - spawn a flower above it
+	glm::vec2 flower_position = collectibles[pot].position + glm::vec2(0.0f, 7.0f);  // 7 pixels above pot
+	
+	// Check if there's already a flower at this position
+	bool flower_exists = false;
+	collectible_grid.for_each_within(flower_position, 4.0f, [&](uint32_t id, glm::vec2 const &position) {
+		glm::vec2 d = position - flower_position;
+		if (collectibles[id].type == "flower" && glm::dot(d, d) < 4.0f * 4.0f) {
+			flower_exists = true;
+			return true;
 		}
+		return false;
+	});
+	
+	// Only spawn flower if one doesn't already exist here
+	if (!flower_exists) {
+		collectibles.push_back({flower_position, "flower", false});
+		flowers_grown += 1;
 	}
 }
 
@@ -507,95 +532,42 @@ void PlayMode::draw_game_over_screen() {
 	uint32_t game_over_start_x = center_x - 4;
 	uint32_t game_over_y = center_y;
 	
+	// (the text goes in the background ring where the camera is looking)
+	auto ring_x = [this](uint32_t screen_x) { return (camera.x / 8 + int32_t(screen_x)) % int32_t(BackgroundLayer::Width); };
+	auto ring_y = [this](uint32_t screen_y) { return (camera.y / 8 + int32_t(screen_y)) % int32_t(BackgroundLayer::Height); };
+	
 	// Draw first row (tiles 64-72) with palette 7
 	for (int i = 0; i < 9; ++i) {
 		uint32_t bg_x = game_over_start_x + i;
 		uint32_t bg_y = game_over_y;
-		uint32_t bg_index = bg_x + bg_y * PPU466::BackgroundWidth;
-		if (bg_index < ppu.background.size() && bg_x < PPU466::BackgroundWidth && bg_y < PPU466::BackgroundHeight) {
-			ppu.background[bg_index] = game_over_tiles[i] | (7 << 8);
-		}
+		background_layer.set_overlay(ring_x(bg_x), ring_y(bg_y), uint16_t(game_over_tiles[i] | (7 << 8)));
 	}
 	
 	// Draw second row (tiles 80-88) with palette 5
 	for (int i = 0; i < 9; ++i) {
 		uint32_t bg_x = game_over_start_x + i;
 		uint32_t bg_y = game_over_y + 1; // One row below
-		uint32_t bg_index = bg_x + bg_y * PPU466::BackgroundWidth;
-		if (bg_index < ppu.background.size() && bg_x < PPU466::BackgroundWidth && bg_y < PPU466::BackgroundHeight) {
-			ppu.background[bg_index] = game_over_tiles[i + 9] | (5 << 8); 
-		}
+		background_layer.set_overlay(ring_x(bg_x), ring_y(bg_y), uint16_t(game_over_tiles[i + 9] | (5 << 8)));
 	}
 }
 
 void PlayMode::restart_game() {
-	std::cout << "Restarting game..." << std::endl;
+	if (verbose) std::cout << "Restarting game..." << std::endl;
 	
 	player_health = 3;
+	hits_taken = 0;
+	flowers_grown = 0;
 	player_at = glm::vec2(0.0f, 0.0f);  // Reset to starting position
+	player_previous_at = player_at;
 	player_facing_right = false;
 	invulnerability_timer = 0.0f;
 	game_over = false;
 	
-	// Reload the level (this clears enemies and collectibles and recreates them)
-	load_level_from_map(get_level_map());
-}
-
-std::vector<std::string> PlayMode::get_level_map() {
-	return {
-		"................................",  
-		"................................",  
-		".................................", 
-		"................U...............",  
-		"................................",  
-		"...L.....................P......",  
-		"................U...############",  
-		"................................",  
-		".....L..........................",  
-		"###......###....................",  
-		"................................",  
-		"................................",  
-		".P..........U...................",  
-		"############....................",  
-		"................................",  
-		"................................",  
-		"................................",  
-		"..U....L.L.L..L.................",  
-		"................................",  
-		"...........................P....",  
-		".................###############",  
-		"................................",  
-		"................................", 
-		"................................",  
-		".......................L........",  
-		".P..............................",  
-		"###############.................",  
-		"................................",  
-		"........................P.......",  
-		".................###############"  
-	};
+	// Restart the level (this clears enemies and collectibles and recreates them)
+	start_level();
 }
 
 void PlayMode::flip_tile_horizontally(PPU466::Tile &tile) {
 	// Flip each row of the tile horizontally by reversing bit order
-	for (int row = 0; row < 8; ++row) {
-		uint8_t original_bit0 = tile.bit0[row];
-		uint8_t original_bit1 = tile.bit1[row];
-		
-		// Reverse the bits in each byte
-		uint8_t flipped_bit0 = 0;
-		uint8_t flipped_bit1 = 0;
-		
-		for (int bit = 0; bit < 8; ++bit) {
-			if (original_bit0 & (1 << bit)) {
-				flipped_bit0 |= (1 << (7 - bit));
-			}
-			if (original_bit1 & (1 << bit)) {
-				flipped_bit1 |= (1 << (7 - bit));
-			}
-		}
-		
-		tile.bit0[row] = flipped_bit0;
-		tile.bit1[row] = flipped_bit1;
-	}
+	mirror_tiles(&tile, 1);
 }
@@ -1,20 +1,43 @@
 #include "PPU466.hpp"
 #include "Mode.hpp"
 #include "Sprites.hpp"
+#include "ppu_record.hpp"
+#include "spatial_grid.hpp"
+#include "patrol.hpp"
+#include "background_layer.hpp"
+#include "sprite_multiplexer.hpp"
+#include "level.hpp"
+#include "input_record.hpp"
 
 #include <glm/glm.hpp>
 
 #include <vector>
 #include <deque>
+#include <fstream>
+#include <memory>
+
+//Everything PlayMode reads from disk, loaded once so that many PlayModes can share it:
+// (e.g., game-headless's batch mode)
+struct PlayData {
+	bool tiles_loaded = false;
+	std::array< PPU466::Tile, 16 * 16 > tile_table;
+	std::array< PPU466::Palette, 8 > palette_table;
+	LevelData level;
+	std::shared_ptr< WorldMap const > world; //(never null -- an empty screen if the level didn't load)
+
+	//from game1_tileset.dat and 'level_file' (failures are reported on std::cerr):
+	static PlayData load(std::string const &level_file = "level1.levl");
+};
 
 struct PlayMode : Mode {
-	PlayMode();
+	PlayMode(); //loads its own PlayData
+	explicit PlayMode(PlayData const &data);
 	virtual ~PlayMode();
 
 	//functions called by main loop:
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) override;
 	virtual void update(float elapsed) override;
-	virtual void draw(glm::uvec2 const &drawable_size) override;
+	virtual void draw(glm::uvec2 const &drawable_size, float alpha) override;
 
 	//----- game state -----
 
@@ -30,31 +53,27 @@ struct PlayMode : Mode {
 	//player position:
 	glm::vec2 player_at = glm::vec2(0.0f);
 	glm::vec2 player_velocity = glm::vec2(0.0f);
+	glm::vec2 player_previous_at = glm::vec2(0.0f); //position before the last update (drawing blends from here)
 	bool player_facing_right = false;  // false = facing left, true = facing right
 	
 	//player health:
 	int player_health = 3;
+	uint32_t hits_taken = 0;     // since the game (re)started
+	uint32_t flowers_grown = 0;  // since the game (re)started
 	float invulnerability_timer = 0.f;  // so that player isn't taking damage too quickly
 	
 	//game state:
 	bool game_over = false;
+	bool verbose = true; //print game events (game over, restart, sprite overflow) to the console
+	float tick_elapsed = 0.0f; //simulated time in the last update (zero if nothing moved)
 
-	//Enemey will move:
-	struct Enemy {
-		glm::vec2 position;
-		glm::vec2 velocity;
-		glm::vec2 start_position;     // Starting position for path
-		glm::vec2 move_direction;     // Direction of movement (normalized)
-		float path_distance = 16.0f; // How far to move in pixels
-		float current_distance = 0.0f; // Current distance traveled
-		bool moving_forward = true;   // Direction on the path
-		bool active = true;
-		SpriteAnimator animator;
-	};
-	std::vector<Enemy> enemies;
+	//Enemies patrol back and forth (stationary ones have a zero-length path):
+	Patrols enemies;
+	SpriteAnimator enemy_animator; //(every enemy is spawned together, so they share one animation)
 	
-	// Level elements - wood blocks are now stored as background tile positions
-	std::vector<glm::ivec2> wood_tile_positions;  // Tile coordinates (not pixel coordinates)
+	// Level elements - compiled by build_level (see level.hpp), loaded once, and copied out on (re)start
+	LevelData level;
+	std::shared_ptr< WorldMap const > world;      // Tiles and solid (wood) tiles, for drawing and collision tests (shared, read-only)
 	
 	struct Collectible {
 		glm::vec2 position;
@@ -63,27 +82,76 @@ struct PlayMode : Mode {
 	};
 	std::vector<Collectible> collectibles;
 
+	//proximity lookups (cells are as big as the largest query radius; each covers a
+	// background-sized area around the player, moved there whenever it is rebuilt):
+	SpatialGrid enemy_grid = SpatialGrid(glm::vec2(0.0f), glm::vec2(PPU466::BackgroundWidth * 8, PPU466::BackgroundHeight * 8), 16.0f); //active enemies, rebuilt every update
+	SpatialGrid collectible_grid = SpatialGrid(glm::vec2(0.0f), glm::vec2(PPU466::BackgroundWidth * 8, PPU466::BackgroundHeight * 8), 16.0f); //rebuilt when needed
+
 	//sprite management:
 	Sprites sprites;                    // All sprite definitions
 	SpriteAnimator player_animator;     // Player animation
-	uint32_t next_sprite_slot = 0;
+	SpriteMultiplexer sprite_multiplexer; // Packs each frame's sprites into ppu.sprites
+	uint32_t reported_dropped = 0;      // Dropped-sprite count last reported (to only log changes)
+	//when there are more sprites than hardware slots, lower priorities flicker first:
+	enum : int32_t {
+		CollectiblePriority = 0,
+		EnemyPriority = 1,
+		HealthPriority = 2,
+		PlayerPriority = 3,
+	};
 
 	//----- drawing handled by PPU466 -----
 
 	PPU466 ppu;
+	BackgroundLayer background_layer; //only changed rows are copied to ppu.background
+	BackgroundStreamer background_streamer; //fills background_layer from the world as the camera moves
+	glm::ivec2 camera = glm::ivec2(0); //world pixel at the bottom left of the screen (as of the last update_ppu)
+	uint32_t tiles_streamed = 0; //background entries the last update_ppu copied in from the world
+
+	//camera position that keeps 'player' (a player position) in view, without looking past the edges of the world:
+	glm::ivec2 camera_for(glm::vec2 const &player) const;
+
+	//set ppu's sprites and background from the game state (everything draw() does except
+	// talking to the GPU, so it also runs headless -- see game-headless.cpp):
+	void update_ppu(float alpha);
+
+	//----- recording (see '--record-ppu' in main.cpp) -----
+
+	//start appending the PPU state of every drawn frame to 'filename':
+	void start_recording(std::string const &filename);
+	std::ofstream recording_file;
+	std::unique_ptr< PPURecorder< PPU466 > > recorder; //null when not recording
+
+	//----- input recording and replay (see '--record-input' and '--replay' in main.cpp) -----
+
+	uint32_t tick = 0; //update() calls so far (input is recorded and replayed by tick)
+
+	//note the input of every tick from now on (save with save_input_recording):
+	void start_input_recording();
+	//fill in the recording's header (ticks and final state_hash) and write it to 'filename':
+	void save_input_recording(std::string const &filename);
+	std::unique_ptr< InputRecording > input_recording; //null when not recording
+	bool restarted = false; //'R' restarted the game since the last tick (for the recording)
+
+	//take the input of every tick from 'recording' instead of from events:
+	// (starting from a freshly constructed PlayMode, as the recording did)
+	void start_replay(InputRecording const &recording);
+	bool replay_finished() const { return replay && tick >= replay->header.ticks; }
+	std::unique_ptr< InputRecording > replay; //null when not replaying
+	size_t replay_next = 0; //first change in replay->changes not yet played
+
+	//hash of the simulation state (player, enemies, collectibles), to check that a replay
+	// ends where its recording did:
+	uint64_t state_hash() const;
 
 	void create_game_sprites();
 	void spawn_enemy(glm::vec2 position);
-	uint32_t allocate_sprite_slots(uint32_t count);
-	void create_level_background();
-	void load_level_from_map(const std::vector<std::string> &level_map);
-	void update_background_with_wood();
+	void start_level();
 	bool check_collision(glm::vec2 position, glm::vec2 size);
 	void check_pot_interaction();
 	void check_enemy_collisions();
 	void spawn_enemy_with_direction(glm::vec2 position, glm::vec2 direction, float distance = 16.0f);
 	void draw_game_over_screen();
 	void restart_game();
-	std::vector<std::string> get_level_map();
 	void flip_tile_horizontally(PPU466::Tile &tile);
 };
@@ -1,6 +1,7 @@
 #include "Sprites.hpp"
 #include "read_write_chunk.hpp"
 #include "data_path.hpp"
+#include "bitplanes.hpp"
 #include <fstream>
 #include <iostream>
 
@@ -92,28 +93,8 @@ void Sprite::draw_frame(PPU466 &ppu, int32_t x, int32_t y, uint32_t start_sprite
             // Copy and flip the tile data
             ppu.tile_table[flipped_tile_index] = ppu.tile_table[original_tile_index];
             
-            // Flip each row of the tile horizontally by reversing bit order
-            PPU466::Tile &tile = ppu.tile_table[flipped_tile_index];
-            for (int row = 0; row < 8; ++row) {
-                uint8_t original_bit0 = tile.bit0[row];
-                uint8_t original_bit1 = tile.bit1[row];
-                
-                // Reverse the bits in each byte
-                uint8_t flipped_bit0 = 0;
-                uint8_t flipped_bit1 = 0;
-                
-                for (int bit = 0; bit < 8; ++bit) {
-                    if (original_bit0 & (1 << bit)) {
-                        flipped_bit0 |= (1 << (7 - bit));
-                    }
-                    if (original_bit1 & (1 << bit)) {
-                        flipped_bit1 |= (1 << (7 - bit));
-                    }
-                }
-                
-                tile.bit0[row] = flipped_bit0;
-                tile.bit1[row] = flipped_bit1;
-            }
+            // Flip the tile horizontally (reverses the bit order of each row)
+            mirror_tiles(&ppu.tile_table[flipped_tile_index], 1);
             
             // Set sprite properties with flipped tile
             hw_sprite.x = uint8_t(std::max(0, std::min(255, final_x)));
@@ -1,6 +1,7 @@
 #include "asset_pipeline.hpp"
 #include "load_save_png.hpp"
 #include "data_path.hpp"
+#include "bitplanes.hpp"
 #include <iostream>
 #include <set>
 #include <map>
@@ -159,31 +160,26 @@ void convert_png_to_tiles_and_palettes(const std::vector<glm::u8vec4> &png_pixel
             analysis.assigned_palette = find_or_create_palette(analysis.unique_colors, palette_table, next_palette_slot);
             std::cout << " -> palette " << (int)analysis.assigned_palette << std::endl;
             
-            // Convert each pixel in this tile
+            // Convert each pixel in this tile to a color index
+            std::array<uint8_t, 8 * 8> indices;
             for (uint32_t y = 0; y < 8; ++y) {
-                uint8_t bit0_row = 0;
-                uint8_t bit1_row = 0;
-                
                 for (uint32_t x = 0; x < 8; ++x) {
                     uint32_t px = tile_x * 8 + x;
                     uint32_t py = tile_y * 8 + y;
                     uint32_t pixel_index = px + py * png_size.x;
                     
+                    indices[x + 8 * y] = 0;
                     if (pixel_index < png_pixels.size()) {
                         glm::u8vec4 pixel = png_pixels[pixel_index];
-                        uint8_t color_index = rgba_to_color_index(pixel, analysis);
-                        
-                        // Convert color index to bit planes
-                        if (color_index & 1) bit0_row |= (1 << x);
-                        if (color_index & 2) bit1_row |= (1 << x);
+                        indices[x + 8 * y] = rgba_to_color_index(pixel, analysis);
                     }
                 }
-                
-                // With LowerLeftOrigin, PNG row 0 is already bottom row
-                // PPU466 expects bit0[0] = bottom row, so direct mapping works
-                tile.bit0[y] = bit0_row;
-                tile.bit1[y] = bit1_row;
             }
+            
+            // Convert color indices to bit planes
+            // With LowerLeftOrigin, PNG row 0 is already bottom row
+            // PPU466 expects bit0[0] = bottom row, so direct mapping works
+            encode_tile(indices.data(), 8, &tile);
         }
     }
     
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "PPU466.hpp"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <stdint.h>
+
+//BackgroundLayer keeps a copy of what PPU466::background should show, so that it can be
+// built once (e.g., per level) and then changed a few entries at a time.
+//
+//It has two parts:
+// - 'base' entries (the level itself), set with set_base()
+// - 'overlay' entries drawn on top (e.g., text), set with set_overlay() and removed all at
+//   once by clear_overlays(), which puts back the base entries underneath
+//
+//Changes are gathered per background row; apply() copies just the changed rows to the PPU
+// and marks them in its background_rows_changed hint.
+struct BackgroundLayer {
+	enum : uint32_t {
+		Width = PPU466::BackgroundWidth,
+		Height = PPU466::BackgroundHeight
+	};
+	static_assert(Height <= 64, "changed rows fit in one 64-bit mask");
+
+	//entries outside the background are ignored:
+	void set_base(int32_t x, int32_t y, uint16_t value) {
+		if (!inside(x, y)) return;
+		uint32_t i = uint32_t(x) + Width * uint32_t(y);
+		base[i] = value;
+		if (!is_overlaid(i)) show(i, value);
+	}
+	void set_base(std::array< uint16_t, Width * Height > const &entries) {
+		for (uint32_t i = 0; i < entries.size(); ++i) {
+			base[i] = entries[i];
+			if (!is_overlaid(i)) show(i, entries[i]);
+		}
+	}
+	void set_overlay(int32_t x, int32_t y, uint16_t value) {
+		if (!inside(x, y)) return;
+		uint32_t i = uint32_t(x) + Width * uint32_t(y);
+		if (!is_overlaid(i)) overlaid.emplace_back(i);
+		show(i, value);
+	}
+	void clear_overlays() {
+		for (uint32_t i : overlaid) {
+			show(i, base[i]);
+		}
+		overlaid.clear();
+	}
+
+	uint16_t get(int32_t x, int32_t y) const {
+		return shown[uint32_t(x) + Width * uint32_t(y)];
+	}
+
+	//copy rows changed since the last apply() into 'ppu' and return them (bit y for row y):
+	// (assumes nothing else writes ppu->background)
+	uint64_t apply(PPU466 *ppu) {
+		uint64_t rows = changed_rows;
+		for (uint32_t y = 0; y < Height; ++y) {
+			if (!((rows >> y) & 1)) continue;
+			std::copy(shown.begin() + Width * y, shown.begin() + Width * (y + 1), ppu->background.begin() + Width * y);
+		}
+		ppu->background_rows_changed |= rows; //(draw() clears the hint once it has used it)
+		changed_rows = 0;
+		return rows;
+	}
+
+	//rows changed since the last apply():
+	uint64_t pending_rows() const { return changed_rows; }
+
+private:
+	std::array< uint16_t, Width * Height > base{};
+	std::array< uint16_t, Width * Height > shown{}; //base with overlays on top
+	std::vector< uint32_t > overlaid; //indices of entries with an overlay (few, so a list is fine)
+	uint64_t changed_rows = ~uint64_t(0);
+
+	static bool inside(int32_t x, int32_t y) {
+		return x >= 0 && x < int32_t(Width) && y >= 0 && y < int32_t(Height);
+	}
+	bool is_overlaid(uint32_t i) const {
+		return std::find(overlaid.begin(), overlaid.end(), i) != overlaid.end();
+	}
+	void show(uint32_t i, uint16_t value) {
+		if (shown[i] == value) return;
+		shown[i] = value;
+		changed_rows |= uint64_t(1) << (i / Width);
+	}
+};
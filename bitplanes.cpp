@@ -0,0 +1,285 @@
+#include "bitplanes.hpp"
+
+#include "cpu_features.hpp"
+#ifdef CPU_FEATURES_X86
+	#include <immintrin.h>
+#endif
+
+static_assert(sizeof(PPU466::Tile) == 16, "tiles are 16 bytes: bit0 rows then bit1 rows");
+
+namespace {
+
+//--------------------------------------------------------------
+//Scalar kernels (the reference the others are checked against):
+
+void decode_tile_scalar(PPU466::Tile const &tile, uint8_t *out, size_t row_stride) {
+	for (uint32_t y = 0; y < 8; ++y) {
+		for (uint32_t x = 0; x < 8; ++x) {
+			out[x + row_stride * y] = uint8_t(
+				  ((tile.bit0[y] >> x) & 1)
+				| ((tile.bit1[y] >> x) & 1) << 1
+			);
+		}
+	}
+}
+
+void decode_tiles_scalar(PPU466::Tile const *tiles, size_t count, uint8_t *out) {
+	for (size_t i = 0; i < count; ++i) {
+		decode_tile_scalar(tiles[i], out + 64 * i, 8);
+	}
+}
+
+void encode_tile_scalar(uint8_t const *indices, size_t row_stride, PPU466::Tile *tile) {
+	for (uint32_t y = 0; y < 8; ++y) {
+		uint8_t bit0 = 0;
+		uint8_t bit1 = 0;
+		for (uint32_t x = 0; x < 8; ++x) {
+			uint8_t index = indices[x + row_stride * y];
+			bit0 |= uint8_t((index & 1) << x);
+			bit1 |= uint8_t(((index >> 1) & 1) << x);
+		}
+		tile->bit0[y] = bit0;
+		tile->bit1[y] = bit1;
+	}
+}
+
+inline uint8_t reverse_bits(uint8_t b) {
+	b = uint8_t((b & 0xf0) >> 4 | (b & 0x0f) << 4);
+	b = uint8_t((b & 0xcc) >> 2 | (b & 0x33) << 2);
+	b = uint8_t((b & 0xaa) >> 1 | (b & 0x55) << 1);
+	return b;
+}
+
+void mirror_tiles_scalar(PPU466::Tile *tiles, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		for (uint32_t y = 0; y < 8; ++y) {
+			tiles[i].bit0[y] = reverse_bits(tiles[i].bit0[y]);
+			tiles[i].bit1[y] = reverse_bits(tiles[i].bit1[y]);
+		}
+	}
+}
+
+#ifdef CPU_FEATURES_X86
+//--------------------------------------------------------------
+//SSE2 kernels:
+// a tile is exactly one 16-byte register (bit0 rows in the low half, bit1 rows in the high half).
+// Decoding repeats each row byte across 8 lanes with unpacks, then tests lane x against (1 << x).
+
+//decoded rows (2y, 2y+1) of 'tile', as 16 bytes:
+struct DecodedSSE2 {
+	__m128i rows[4];
+};
+
+inline DecodedSSE2 decode_sse2(__m128i tile) {
+	__m128i const bit_of_lane = _mm_set_epi8(
+		-128, 64, 32, 16, 8, 4, 2, 1,
+		-128, 64, 32, 16, 8, 4, 2, 1
+	);
+	__m128i const one = _mm_set1_epi8(1);
+	__m128i const two = _mm_set1_epi8(2);
+
+	//broadcast each row byte of a plane across 8 lanes; returns rows (0,1), (2,3), (4,5), (6,7):
+	auto spread = [](__m128i bytes2x, __m128i out[4]) {
+		//bytes2x holds each row byte twice: r0 r0 r1 r1 ... r7 r7
+		__m128i lo4 = _mm_unpacklo_epi16(bytes2x, bytes2x); //r0 x4, r1 x4, r2 x4, r3 x4
+		__m128i hi4 = _mm_unpackhi_epi16(bytes2x, bytes2x); //r4 x4 ... r7 x4
+		out[0] = _mm_unpacklo_epi32(lo4, lo4);
+		out[1] = _mm_unpackhi_epi32(lo4, lo4);
+		out[2] = _mm_unpacklo_epi32(hi4, hi4);
+		out[3] = _mm_unpackhi_epi32(hi4, hi4);
+	};
+
+	__m128i plane0[4], plane1[4];
+	spread(_mm_unpacklo_epi8(tile, tile), plane0);
+	spread(_mm_unpackhi_epi8(tile, tile), plane1);
+
+	DecodedSSE2 ret;
+	for (uint32_t i = 0; i < 4; ++i) {
+		__m128i b0 = _mm_cmpeq_epi8(_mm_and_si128(plane0[i], bit_of_lane), bit_of_lane);
+		__m128i b1 = _mm_cmpeq_epi8(_mm_and_si128(plane1[i], bit_of_lane), bit_of_lane);
+		ret.rows[i] = _mm_or_si128(_mm_and_si128(b0, one), _mm_and_si128(b1, two));
+	}
+	return ret;
+}
+
+void decode_tiles_sse2(PPU466::Tile const *tiles, size_t count, uint8_t *out) {
+	for (size_t i = 0; i < count; ++i) {
+		DecodedSSE2 d = decode_sse2(_mm_loadu_si128(reinterpret_cast< __m128i const * >(&tiles[i])));
+		for (uint32_t r = 0; r < 4; ++r) {
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(out + 64 * i + 16 * r), d.rows[r]);
+		}
+	}
+}
+
+void decode_tile_sse2(PPU466::Tile const &tile, uint8_t *out, size_t row_stride) {
+	DecodedSSE2 d = decode_sse2(_mm_loadu_si128(reinterpret_cast< __m128i const * >(&tile)));
+	for (uint32_t r = 0; r < 4; ++r) {
+		_mm_storel_epi64(reinterpret_cast< __m128i * >(out + row_stride * (2 * r + 0)), d.rows[r]);
+		_mm_storel_epi64(reinterpret_cast< __m128i * >(out + row_stride * (2 * r + 1)), _mm_unpackhi_epi64(d.rows[r], d.rows[r]));
+	}
+}
+
+//encoding: shifting each byte's bit k up to bit 7 lets movemask collect a row's worth of bits at once.
+// (16-bit shifts leak bits between the two bytes of a lane, but never into bit 7 of either byte)
+void encode_tile_sse2(uint8_t const *indices, size_t row_stride, PPU466::Tile *tile) {
+	for (uint32_t y = 0; y < 8; y += 2) {
+		__m128i rows = _mm_unpacklo_epi64(
+			_mm_loadl_epi64(reinterpret_cast< __m128i const * >(indices + row_stride * (y + 0))),
+			_mm_loadl_epi64(reinterpret_cast< __m128i const * >(indices + row_stride * (y + 1)))
+		);
+		uint32_t bit0 = uint32_t(_mm_movemask_epi8(_mm_slli_epi16(rows, 7)));
+		uint32_t bit1 = uint32_t(_mm_movemask_epi8(_mm_slli_epi16(rows, 6)));
+		tile->bit0[y + 0] = uint8_t(bit0);
+		tile->bit0[y + 1] = uint8_t(bit0 >> 8);
+		tile->bit1[y + 0] = uint8_t(bit1);
+		tile->bit1[y + 1] = uint8_t(bit1 >> 8);
+	}
+}
+
+//bit reversal of every byte: swap nibbles, then pairs, then single bits:
+// (16-bit shifts are fine because the masks drop anything that crossed a byte boundary)
+inline __m128i reverse_bits_sse2(__m128i v) {
+	__m128i const m0f = _mm_set1_epi8(0x0f);
+	__m128i const m33 = _mm_set1_epi8(0x33);
+	__m128i const m55 = _mm_set1_epi8(0x55);
+	v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 4), m0f), _mm_slli_epi16(_mm_and_si128(v, m0f), 4));
+	v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 2), m33), _mm_slli_epi16(_mm_and_si128(v, m33), 2));
+	v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 1), m55), _mm_slli_epi16(_mm_and_si128(v, m55), 1));
+	return v;
+}
+
+void mirror_tiles_sse2(PPU466::Tile *tiles, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		__m128i *p = reinterpret_cast< __m128i * >(&tiles[i]);
+		_mm_storeu_si128(p, reverse_bits_sse2(_mm_loadu_si128(p)));
+	}
+}
+
+//--------------------------------------------------------------
+//AVX2 kernels:
+// the same operations, two tiles at a time (one per 128-bit lane -- AVX2 unpacks work within lanes).
+
+CPU_TARGET_AVX2
+void decode_tiles_avx2(PPU466::Tile const *tiles, size_t count, uint8_t *out) {
+	__m256i const bit_of_lane = _mm256_set_epi8(
+		-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1,
+		-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1
+	);
+	__m256i const one = _mm256_set1_epi8(1);
+	__m256i const two = _mm256_set1_epi8(2);
+
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		//tile i in the low lane, tile i+1 in the high lane:
+		__m256i pair = _mm256_loadu_si256(reinterpret_cast< __m256i const * >(&tiles[i]));
+
+		__m256i planes[2] = { _mm256_unpacklo_epi8(pair, pair), _mm256_unpackhi_epi8(pair, pair) };
+		__m256i rows[4];
+		for (uint32_t r = 0; r < 4; ++r) rows[r] = _mm256_setzero_si256();
+
+		for (uint32_t p = 0; p < 2; ++p) {
+			__m256i lo4 = _mm256_unpacklo_epi16(planes[p], planes[p]);
+			__m256i hi4 = _mm256_unpackhi_epi16(planes[p], planes[p]);
+			__m256i spread[4] = {
+				_mm256_unpacklo_epi32(lo4, lo4),
+				_mm256_unpackhi_epi32(lo4, lo4),
+				_mm256_unpacklo_epi32(hi4, hi4),
+				_mm256_unpackhi_epi32(hi4, hi4),
+			};
+			__m256i value = (p == 0 ? one : two);
+			for (uint32_t r = 0; r < 4; ++r) {
+				__m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(spread[r], bit_of_lane), bit_of_lane);
+				rows[r] = _mm256_or_si256(rows[r], _mm256_and_si256(set, value));
+			}
+		}
+
+		//regroup lanes so each tile's 64 bytes are contiguous:
+		uint8_t *a = out + 64 * i;
+		uint8_t *b = a + 64;
+		_mm256_storeu_si256(reinterpret_cast< __m256i * >(a + 0), _mm256_permute2x128_si256(rows[0], rows[1], 0x20));
+		_mm256_storeu_si256(reinterpret_cast< __m256i * >(a + 32), _mm256_permute2x128_si256(rows[2], rows[3], 0x20));
+		_mm256_storeu_si256(reinterpret_cast< __m256i * >(b + 0), _mm256_permute2x128_si256(rows[0], rows[1], 0x31));
+		_mm256_storeu_si256(reinterpret_cast< __m256i * >(b + 32), _mm256_permute2x128_si256(rows[2], rows[3], 0x31));
+	}
+
+	if (i < count) decode_tiles_sse2(tiles + i, count - i, out + 64 * i);
+}
+
+CPU_TARGET_AVX2
+void mirror_tiles_avx2(PPU466::Tile *tiles, size_t count) {
+	__m256i const m0f = _mm256_set1_epi8(0x0f);
+	__m256i const m33 = _mm256_set1_epi8(0x33);
+	__m256i const m55 = _mm256_set1_epi8(0x55);
+
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		__m256i *p = reinterpret_cast< __m256i * >(&tiles[i]);
+		__m256i v = _mm256_loadu_si256(p);
+		v = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(v, 4), m0f), _mm256_slli_epi16(_mm256_and_si256(v, m0f), 4));
+		v = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(v, 2), m33), _mm256_slli_epi16(_mm256_and_si256(v, m33), 2));
+		v = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(v, 1), m55), _mm256_slli_epi16(_mm256_and_si256(v, m55), 1));
+		_mm256_storeu_si256(p, v);
+	}
+
+	if (i < count) mirror_tiles_sse2(tiles + i, count - i);
+}
+#endif //CPU_FEATURES_X86
+
+//--------------------------------------------------------------
+//Dispatch:
+
+struct Kernels {
+	BitplaneKernel kernel;
+	void (*decode_tiles)(PPU466::Tile const *, size_t, uint8_t *);
+	void (*decode_tile)(PPU466::Tile const &, uint8_t *, size_t);
+	void (*encode_tile)(uint8_t const *, size_t, PPU466::Tile *);
+	void (*mirror_tiles)(PPU466::Tile *, size_t);
+};
+
+Kernels const ScalarKernels{ BitplaneKernel::Scalar, decode_tiles_scalar, decode_tile_scalar, encode_tile_scalar, mirror_tiles_scalar };
+#ifdef CPU_FEATURES_X86
+Kernels const SSE2Kernels{ BitplaneKernel::SSE2, decode_tiles_sse2, decode_tile_sse2, encode_tile_sse2, mirror_tiles_sse2 };
+//(single tiles don't fill an AVX2 register, so decode_tile and encode_tile stay on SSE2 --
+// gathering four strided rows into one ymm register measured slower than two SSE2 movemasks)
+Kernels const AVX2Kernels{ BitplaneKernel::AVX2, decode_tiles_avx2, decode_tile_sse2, encode_tile_sse2, mirror_tiles_avx2 };
+#endif
+
+SIMDDispatch< Kernels > &dispatch() {
+	//set up on first use (so it also works during static initialization):
+	#ifdef CPU_FEATURES_X86
+	static SIMDDispatch< Kernels > dispatch({ &ScalarKernels, &SSE2Kernels, &AVX2Kernels });
+	#else
+	static SIMDDispatch< Kernels > dispatch({ &ScalarKernels, nullptr, nullptr });
+	#endif
+	return dispatch;
+}
+
+} //namespace
+
+void decode_tiles(PPU466::Tile const *tiles, size_t count, uint8_t *indices) {
+	dispatch()->decode_tiles(tiles, count, indices);
+}
+
+void decode_tile(PPU466::Tile const &tile, uint8_t *indices, size_t row_stride) {
+	dispatch()->decode_tile(tile, indices, row_stride);
+}
+
+void encode_tile(uint8_t const *indices, size_t row_stride, PPU466::Tile *tile) {
+	dispatch()->encode_tile(indices, row_stride, tile);
+}
+
+void mirror_tiles(PPU466::Tile *tiles, size_t count) {
+	dispatch()->mirror_tiles(tiles, count);
+}
+
+BitplaneKernel bitplane_kernel() {
+	return dispatch()->kernel;
+}
+
+char const *bitplane_kernel_name(BitplaneKernel kernel) {
+	return simd_kernel_name(kernel);
+}
+
+bool set_bitplane_kernel(BitplaneKernel kernel) {
+	return dispatch().set(kernel);
+}
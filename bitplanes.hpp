@@ -0,0 +1,40 @@
+#pragma once
+
+#include "PPU466.hpp"
+#include "cpu_features.hpp"
+
+#include <cstddef>
+#include <stdint.h>
+
+/*
+ * Conversion between PPU466 tiles (two 8x8 bit planes) and color indices (one byte per pixel).
+ *
+ * Every function here has a scalar version and, on x86-64, SSE2 and AVX2 versions;
+ * the fastest one the CPU supports is picked the first time any of them is called.
+ *
+ * Index images use the same layout as the tiles themselves:
+ *  rows from bottom to top, and pixel x of row y at index x + row_stride * y
+ * Only the low two bits of each index are used when encoding.
+ */
+
+//decode 'count' tiles, each into 64 consecutive bytes (8 rows of 8):
+void decode_tiles(PPU466::Tile const *tiles, size_t count, uint8_t *indices);
+
+//decode one tile into an 8x8 block of a larger image (e.g., a row of a tile atlas):
+void decode_tile(PPU466::Tile const &tile, uint8_t *indices, size_t row_stride);
+
+//encode an 8x8 block of color indices as a tile:
+void encode_tile(uint8_t const *indices, size_t row_stride, PPU466::Tile *tile);
+
+//mirror 'count' tiles left-to-right (in place):
+void mirror_tiles(PPU466::Tile *tiles, size_t count);
+
+//which implementation is in use:
+// (picked and switched with SIMDDispatch; see cpu_features.hpp)
+using BitplaneKernel = SIMDKernel;
+BitplaneKernel bitplane_kernel();
+char const *bitplane_kernel_name(BitplaneKernel kernel);
+
+//for benchmarks and self-checks -- switch to another implementation:
+// returns false (and changes nothing) if this CPU or build can't run 'kernel'
+bool set_bitplane_kernel(BitplaneKernel kernel);
@@ -0,0 +1,83 @@
+#include "level.hpp"
+#include "load_save_png.hpp"
+
+#include <bit>
+#include <fstream>
+#include <iostream>
+
+//build_level compiles a level source into the "LEVL" and world map chunks the game loads:
+//
+// usage:
+//   build_level <input.txt|input.png> <output.levl>
+//
+//Text sources use the characters listed with compile_level_text (level.hpp).
+//PNG sources use one pixel per tile (top row of the image = top of the level), colored:
+//   black: wall     red: stationary enemy     orange: enemy patrolling left/right
+//   magenta: enemy patrolling up/down         pink: heart   blue: pot   yellow: flower
+//   anything transparent or white: empty
+
+//text-map character for a PNG pixel:
+static char legend(glm::u8vec4 px) {
+	if (px.a < 0x80) return '.';
+	glm::u8vec3 rgb(px.r, px.g, px.b);
+	if (rgb == glm::u8vec3(0x00, 0x00, 0x00)) return '#';
+	if (rgb == glm::u8vec3(0xff, 0x00, 0x00)) return 'E';
+	if (rgb == glm::u8vec3(0xff, 0x80, 0x00)) return 'L';
+	if (rgb == glm::u8vec3(0xff, 0x00, 0xff)) return 'U';
+	if (rgb == glm::u8vec3(0xff, 0x80, 0x80)) return 'H';
+	if (rgb == glm::u8vec3(0x00, 0x00, 0xff)) return 'P';
+	if (rgb == glm::u8vec3(0xff, 0xff, 0x00)) return 'F';
+	if (rgb == glm::u8vec3(0xff, 0xff, 0xff)) return '.';
+	throw std::runtime_error("Unexpected level color (" + std::to_string(px.r) + ", " + std::to_string(px.g) + ", " + std::to_string(px.b) + ").");
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <input.txt|input.png> <output.levl>" << std::endl;
+		return 1;
+	}
+	std::string input = argv[1];
+	std::string output = argv[2];
+
+	try {
+		std::vector< std::string > rows;
+		if (input.size() >= 4 && input.substr(input.size() - 4) == ".png") {
+			glm::uvec2 size;
+			std::vector< glm::u8vec4 > data;
+			load_png(input, &size, &data, UpperLeftOrigin);
+			for (uint32_t y = 0; y < size.y; ++y) {
+				std::string row;
+				for (uint32_t x = 0; x < size.x; ++x) {
+					row += legend(data[x + size.x * y]);
+				}
+				rows.emplace_back(row);
+			}
+		} else {
+			std::ifstream in(input);
+			if (!in) throw std::runtime_error("Failed to open '" + input + "'.");
+			std::string line;
+			while (std::getline(in, line)) {
+				if (!line.empty() && line.back() == '\r') line.pop_back();
+				rows.emplace_back(line);
+			}
+		}
+
+		LevelData level;
+		WorldMap world;
+		compile_level_text(rows, &level, &world);
+		write_level(output, level, world);
+
+		uint32_t walls = 0;
+		for (uint32_t index : world.chunk_index) {
+			for (uint16_t row : world.chunks[index].solid) walls += uint32_t(std::popcount(row));
+		}
+		std::cout << "Generated " << output << " (" << sizeof(LevelData) + world.bytes() << " bytes): "
+			<< world.width << "x" << world.height << " tiles in " << world.chunks.size() << " unique chunks of " << world.chunk_index.size() << ", "
+			<< walls << " wall tiles, " << level.spawn_count << " spawns" << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "Failed to build level from '" << input << "': " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
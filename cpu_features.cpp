@@ -0,0 +1,48 @@
+#include "cpu_features.hpp"
+
+#if defined(CPU_FEATURES_X86) && defined(_MSC_VER) && !defined(__clang__)
+	#include <intrin.h>
+#endif
+
+namespace {
+
+#ifdef CPU_FEATURES_X86
+bool cpu_has_avx2() {
+	#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx) return false;
+	if ((_xgetbv(0) & 0x6) != 0x6) return false; //OS saves ymm registers
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+	#else
+	__builtin_cpu_init(); //(needed if this runs before the runtime's own initialization)
+	return __builtin_cpu_supports("avx2");
+	#endif
+}
+#endif //CPU_FEATURES_X86
+
+} //namespace
+
+char const *simd_kernel_name(SIMDKernel kernel) {
+	switch (kernel) {
+		case SIMDKernel::Scalar: return "scalar";
+		case SIMDKernel::SSE2: return "sse2";
+		case SIMDKernel::AVX2: return "avx2";
+	}
+	return "unknown";
+}
+
+bool cpu_can_run(SIMDKernel kernel) {
+	if (kernel == SIMDKernel::Scalar) return true;
+	#ifdef CPU_FEATURES_X86
+	if (kernel == SIMDKernel::SSE2) return true;
+	if (kernel == SIMDKernel::AVX2) {
+		static bool const has_avx2 = cpu_has_avx2();
+		return has_avx2;
+	}
+	#endif
+	return false;
+}
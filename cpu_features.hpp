@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <stdint.h>
+
+/*
+ * What the CPU can do, and picking among SIMD versions of a routine to match.
+ *
+ * Code with SIMD kernels (bitplanes.cpp, patrol.cpp) builds a scalar version everywhere and,
+ * on x86-64, SSE2 and AVX2 versions. SSE2 is part of the x86-64 baseline; AVX2 kernels are
+ * compiled with CPU_TARGET_AVX2 and only run if cpu_can_run() says the CPU supports them.
+ * (Kernel files include <immintrin.h> themselves, when CPU_FEATURES_X86 is defined.)
+ */
+
+#if defined(__x86_64__) || defined(_M_X64)
+	#define CPU_FEATURES_X86 1
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#define CPU_TARGET_AVX2
+	#else
+		#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#endif
+
+//versions of a SIMD routine, slowest to fastest:
+enum class SIMDKernel : uint8_t {
+	Scalar,
+	SSE2,
+	AVX2,
+};
+constexpr uint32_t SIMDKernelCount = 3;
+
+char const *simd_kernel_name(SIMDKernel kernel);
+
+//does this CPU (and build) support 'kernel'?
+// (checks cpuid the first time it is asked about AVX2)
+bool cpu_can_run(SIMDKernel kernel);
+
+//SIMDDispatch holds the versions of a routine -- 'Impl' is a struct of function pointers with
+// a 'SIMDKernel kernel' member -- and which one is in use, starting with the fastest that can run:
+//
+//  SIMDDispatch< Kernels > &dispatch() {
+//      //(made on first use, so it also works during static initialization)
+//      static SIMDDispatch< Kernels > dispatch({ &ScalarKernels, &SSE2Kernels, &AVX2Kernels });
+//      return dispatch;
+//  }
+template< typename Impl >
+struct SIMDDispatch {
+	//'impls' is indexed by SIMDKernel; nullptr for versions this build doesn't have (Scalar is required):
+	explicit SIMDDispatch(std::array< Impl const *, SIMDKernelCount > const &impls_) : impls(impls_), active(impls_[0]) {
+		for (SIMDKernel k : { SIMDKernel::AVX2, SIMDKernel::SSE2 }) {
+			if (set(k)) break;
+		}
+	}
+
+	//the version for 'kernel', or nullptr if it can't run here:
+	Impl const *find(SIMDKernel kernel) const {
+		if (!cpu_can_run(kernel)) return nullptr;
+		return impls[uint32_t(kernel)];
+	}
+
+	//switch to 'kernel' (for benchmarks and self-checks); returns false (and changes nothing) if it can't run here:
+	bool set(SIMDKernel kernel) {
+		Impl const *found = find(kernel);
+		if (!found) return false;
+		active = found;
+		return true;
+	}
+
+	Impl const *operator->() const { return active; }
+
+	std::array< Impl const *, SIMDKernelCount > impls;
+	Impl const *active;
+};
@@ -0,0 +1,176 @@
+#include "frame_capture.hpp"
+
+#include "gl_state.hpp"
+#include "load_save_png.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+FrameCapture::FrameCapture() {
+	for (auto &readback : readbacks) {
+		glGenBuffers(1, &readback.buffer);
+	}
+
+	worker = std::thread([this](){
+		std::unique_lock< std::mutex > lock(mutex);
+		while (true) {
+			wake.wait(lock, [this](){ return quit || !jobs.empty(); });
+			if (jobs.empty()) break; //(quit, and nothing left to save)
+
+			Job job = std::move(jobs.front());
+			jobs.pop_front();
+
+			lock.unlock();
+			//the framebuffer's alpha isn't meaningful, so save opaque pixels:
+			for (auto &px : job.pixels) {
+				px.a = 0xff;
+			}
+			try {
+				save_png(job.filename, job.size, job.pixels.data(), LowerLeftOrigin);
+			} catch (std::exception const &e) {
+				std::cerr << "Failed to save '" << job.filename << "': " << e.what() << std::endl;
+			}
+			lock.lock();
+
+			saved += 1;
+		}
+	});
+}
+
+FrameCapture::~FrameCapture() {
+	//read back everything still on the GPU, oldest first:
+	for (uint32_t i = 0; i < ReadbackCount; ++i) {
+		retire(&readbacks[(next_readback + i) % ReadbackCount], true);
+	}
+	for (auto &readback : readbacks) {
+		glDeleteBuffers(1, &readback.buffer);
+		readback.buffer = 0;
+	}
+
+	//let the worker finish the queue:
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_one();
+	worker.join();
+}
+
+void FrameCapture::screenshot(std::string const &filename) {
+	screenshot_filename = filename;
+}
+
+void FrameCapture::start_continuous(std::string const &prefix) {
+	assert(!prefix.empty());
+	continuous_prefix = prefix;
+	continuous_frame = 0;
+}
+
+void FrameCapture::stop_continuous() {
+	continuous_prefix.clear();
+}
+
+uint64_t FrameCapture::frames_saved() const {
+	std::unique_lock< std::mutex > lock(mutex);
+	return saved;
+}
+
+size_t FrameCapture::frames_queued() const {
+	std::unique_lock< std::mutex > lock(mutex);
+	return jobs.size();
+}
+
+void FrameCapture::after_draw(glm::uvec2 const &size, GLuint texture) {
+	//hand off any readbacks that have finished since last frame (without waiting):
+	for (uint32_t i = 0; i < ReadbackCount; ++i) {
+		retire(&readbacks[(next_readback + i) % ReadbackCount], false);
+	}
+
+	if (!screenshot_filename.empty()) {
+		read(size, texture, screenshot_filename);
+		screenshot_filename.clear();
+	}
+	if (!continuous_prefix.empty()) {
+		std::ostringstream filename;
+		filename << continuous_prefix << std::setw(6) << std::setfill('0') << continuous_frame << ".png";
+		read(size, texture, filename.str());
+		continuous_frame += 1;
+	}
+}
+
+void FrameCapture::read(glm::uvec2 const &size, GLuint texture, std::string const &filename) {
+	Readback &readback = readbacks[next_readback];
+	next_readback = (next_readback + 1) % ReadbackCount;
+
+	//the oldest readback is still in flight; finish it:
+	if (readback.fence) {
+		readback_waits += 1;
+		retire(&readback, true);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	size_t const bytes = size_t(size.x) * size_t(size.y) * sizeof(glm::u8vec4);
+	if (bytes > readback.capacity) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+		readback.capacity = bytes;
+	}
+
+	//with a pixel-pack buffer bound, these queue a copy into the buffer instead of waiting for the pixels:
+	if (texture) {
+		gl_state.bind_texture(texture);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	} else {
+		gl_state.bind_framebuffer(GL_READ_FRAMEBUFFER, 0);
+		glReadBuffer(GL_BACK);
+		glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.size = size;
+	readback.filename = filename;
+	frames_read += 1;
+}
+
+bool FrameCapture::retire(Readback *readback_, bool wait) {
+	assert(readback_);
+	Readback &readback = *readback_;
+	if (!readback.fence) return false;
+
+	GLenum result = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (result == GL_TIMEOUT_EXPIRED) {
+		if (!wait) return false;
+		do {
+			result = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); //(timeout in nanoseconds)
+		} while (result == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(readback.fence);
+	readback.fence = nullptr;
+
+	Job job;
+	job.filename = readback.filename;
+	job.size = readback.size;
+	job.pixels.resize(size_t(readback.size.x) * size_t(readback.size.y));
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	size_t const bytes = job.pixels.size() * sizeof(glm::u8vec4);
+	void const *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+	if (mapped) {
+		std::memcpy(job.pixels.data(), mapped, bytes);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	} else {
+		//(mapping shouldn't fail, but if it does, this is still correct -- just maybe slower)
+		glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, bytes, job.pixels.data());
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		jobs.emplace_back(std::move(job));
+	}
+	wake.notify_one();
+	return true;
+}
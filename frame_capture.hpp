@@ -0,0 +1,84 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+//FrameCapture saves drawn frames as PNG files without stalling the main loop:
+// - pixels are copied into pixel-buffer objects (so glReadPixels / glGetTexImage return right away),
+// - each buffer is mapped a frame or two later, once its fence says the copy has finished, and
+// - PNG encoding and file writing happen on a worker thread.
+//
+//Frames are never dropped: if every buffer is still in flight the oldest one is waited on,
+// and the worker's queue grows (in memory) if encoding falls behind.
+//
+//Needs an OpenGL context for its whole lifetime (destroy it before the context).
+struct FrameCapture {
+	FrameCapture();
+	~FrameCapture(); //saves everything still pending (waiting for the GPU and the worker)
+	FrameCapture(FrameCapture const &) = delete;
+
+	//save the next frame passed to after_draw() as 'filename':
+	void screenshot(std::string const &filename);
+
+	//save every frame passed to after_draw() as '<prefix>NNNNNN.png' until stop_continuous():
+	void start_continuous(std::string const &prefix);
+	void stop_continuous();
+	bool continuous() const { return !continuous_prefix.empty(); }
+
+	//call once per frame, after drawing and before swapping buffers:
+	// frames are read from 'texture' (an RGBA8 GL_TEXTURE_2D that is exactly 'size' pixels),
+	// or, if 'texture' is 0, from the back buffer of the default framebuffer.
+	void after_draw(glm::uvec2 const &size, GLuint texture = 0);
+
+	//counters since startup:
+	uint64_t frames_read = 0; //frames copied into pixel-buffer objects
+	uint64_t readback_waits = 0; //times after_draw() had to wait for the GPU to free a buffer
+	uint64_t frames_saved() const; //frames the worker has written to disk
+	size_t frames_queued() const; //frames read back but not yet written
+
+private:
+	//a frame being copied into a pixel-buffer object:
+	struct Readback {
+		GLuint buffer = 0; //GL_PIXEL_PACK_BUFFER holding the pixels
+		size_t capacity = 0; //size of 'buffer' in bytes
+		GLsync fence = nullptr; //fence after the copy into 'buffer' (null if the buffer is free)
+		glm::uvec2 size = glm::uvec2(0);
+		std::string filename;
+	};
+	static constexpr uint32_t ReadbackCount = 3;
+	std::array< Readback, ReadbackCount > readbacks;
+	uint32_t next_readback = 0; //(also the oldest one, once all have been used)
+
+	std::string screenshot_filename; //non-empty if a screenshot was asked for
+	std::string continuous_prefix; //non-empty while capturing continuously
+	uint32_t continuous_frame = 0; //number of the next continuous frame
+
+	//start copying a frame into the next readback (waiting on it first if needed):
+	void read(glm::uvec2 const &size, GLuint texture, std::string const &filename);
+	//map a readback's buffer and hand the pixels to the worker; with 'wait', waits for the copy to finish:
+	// returns false (doing nothing) if the copy hasn't finished and 'wait' is false
+	bool retire(Readback *readback, bool wait);
+
+	//worker thread state (guarded by 'mutex'):
+	struct Job {
+		std::string filename;
+		glm::uvec2 size;
+		std::vector< glm::u8vec4 > pixels; //rows from the bottom up
+	};
+	mutable std::mutex mutex;
+	std::condition_variable wake; //notified when a job is added or 'quit' is set
+	std::deque< Job > jobs;
+	uint64_t saved = 0;
+	bool quit = false;
+	std::thread worker;
+};
@@ -0,0 +1,54 @@
+#include "frame_times.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+
+void FrameTimes::report(std::ostream &out, char const *indent) const {
+	if (ms.empty()) {
+		out << indent << "(no frames)\n";
+		return;
+	}
+
+	std::vector< float > sorted = ms;
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&sorted](float p) {
+		return sorted[std::min(sorted.size() - 1, size_t(p * float(sorted.size())))];
+	};
+	double total = 0.0;
+	for (float t : sorted) total += t;
+
+	std::ios_base::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+
+	out << std::fixed << std::setprecision(4)
+		<< indent << sorted.size() << " frames, mean " << total / sorted.size() << " ms\n"
+		<< indent << "p50 " << percentile(0.50f) << " ms, p90 " << percentile(0.90f)
+		<< " ms, p99 " << percentile(0.99f) << " ms, max " << sorted.back() << " ms\n";
+
+	//buckets [2^k, 2^(k+1)) ms, from the one holding the fastest frame to the one holding the slowest:
+	// (anything under 2^-12 ms -- a quarter of a nanosecond -- goes in the first bucket)
+	auto bucket_of = [](float t) {
+		return int32_t(std::floor(std::log2(std::max(t, std::ldexp(1.0f, -12)))));
+	};
+	int32_t const first = bucket_of(sorted.front());
+	int32_t const last = bucket_of(sorted.back());
+	std::vector< size_t > counts(size_t(last - first + 1), 0);
+	for (float t : sorted) counts[size_t(bucket_of(t) - first)] += 1;
+	size_t const most = *std::max_element(counts.begin(), counts.end());
+
+	constexpr size_t BarWidth = 40;
+	for (int32_t k = first; k <= last; ++k) {
+		size_t count = counts[size_t(k - first)];
+		out << indent << "[" << std::setw(9) << std::ldexp(1.0, k) << ", " << std::setw(9) << std::ldexp(1.0, k + 1) << ") ms "
+			<< std::setw(8) << count << " " << std::setw(6) << std::setprecision(2) << 100.0 * count / sorted.size() << "% "
+			<< std::string((count * BarWidth + most - 1) / most, '#') << '\n'
+			<< std::setprecision(4);
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
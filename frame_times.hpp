@@ -0,0 +1,16 @@
+#pragma once
+
+#include <iosfwd>
+#include <vector>
+
+//FrameTimes collects how long each frame (or tick) took and summarizes them
+// as percentiles and a histogram -- e.g., for comparing builds on the same replay.
+struct FrameTimes {
+	std::vector< float > ms; //one entry per frame, in milliseconds
+
+	void add(float frame_ms) { ms.emplace_back(frame_ms); }
+
+	//print count, mean, p50/p90/p99/max, and a histogram with doubling bucket widths to 'out':
+	// (each line starts with 'indent')
+	void report(std::ostream &out, char const *indent = "  ") const;
+};
@@ -0,0 +1,420 @@
+//game-bench times gameplay code paths (no window needed), checking each fast path
+// against the simple version it replaced before timing both.
+//
+// usage:
+//   game-bench [--queries N] [benchmark ...]
+//
+// benchmarks (default: all of them, one after the other):
+//   collision -- 16x16 box vs. wall tiles: scanning the wall list vs. WorldMap::any_solid
+//                (as PlayMode::check_collision uses it), on random maps of increasing density
+//   proximity -- radius queries against growing numbers of hazards: scanning every hazard
+//                vs. a SpatialGrid rebuilt each tick (player vs. hazards, and hazards vs. each other)
+//   patrol    -- back-and-forth movement of 100k hazards: PlayMode's old per-enemy ping-pong update
+//                vs. each Patrols::step kernel, against a 1 ms per-frame budget
+
+#include "world_map.hpp"
+#include "spatial_grid.hpp"
+#include "patrol.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+//run 'fn' and return how long it took, in milliseconds:
+static double time_ms(std::function< void() > const &fn) {
+	auto before = std::chrono::high_resolution_clock::now();
+	fn();
+	auto after = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration< double, std::milli >(after - before).count();
+}
+
+//------------ collision ------------
+
+//tile range covered by a box, computed the way PlayMode::check_collision does:
+struct TileBox {
+	int32_t left, bottom, right, top;
+};
+static TileBox tile_box(glm::vec2 position, glm::vec2 size) {
+	return TileBox{
+		int32_t(position.x / 8.0f),
+		int32_t(position.y / 8.0f),
+		int32_t((position.x + size.x - 1) / 8.0f),
+		int32_t((position.y + size.y - 1) / 8.0f)
+	};
+}
+
+//the wall-list scan PlayMode::check_collision used before its wall bitsets (now WorldMap's):
+static bool collides_list(std::vector< glm::ivec2 > const &walls, TileBox const &box) {
+	for (int32_t y = box.bottom; y <= box.top; ++y) {
+		for (int32_t x = box.left; x <= box.right; ++x) {
+			for (auto const &wall : walls) {
+				if (wall.x == x && wall.y == y) return true;
+			}
+		}
+	}
+	return false;
+}
+
+static bool run_collision(uint32_t queries) {
+	bool ok = true;
+
+	//a multi-screen level, like levels/meadow.txt:
+	constexpr uint32_t MapWidth = 256, MapHeight = 60;
+
+	std::cout << "\ncollision (" << queries << " 16x16 box queries per " << MapWidth << "x" << MapHeight << " map):\n";
+	std::cout << "  " << std::left << std::setw(10) << "density" << std::right
+		<< std::setw(8) << "walls" << std::setw(8) << "hits"
+		<< std::setw(14) << "list ns/q" << std::setw(14) << "map ns/q" << std::setw(10) << "speedup" << '\n';
+
+	for (float density : {0.02f, 0.1f, 0.25f, 0.5f}) {
+		std::mt19937 mt(0x466);
+
+		//random map with (about) 'density' of the tiles solid:
+		std::vector< glm::ivec2 > walls;
+		std::vector< uint8_t > solid(MapWidth * MapHeight, 0);
+		std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+		for (int32_t y = 0; y < int32_t(MapHeight); ++y) {
+			for (int32_t x = 0; x < int32_t(MapWidth); ++x) {
+				if (unit(mt) < density) {
+					walls.emplace_back(x, y);
+					solid[x + MapWidth * y] = 1;
+				}
+			}
+		}
+		WorldMap world;
+		world.build(MapWidth, MapHeight, std::vector< uint16_t >(MapWidth * MapHeight, 0), solid);
+
+		//random boxes, including some hanging off the edges of the map:
+		std::uniform_real_distribution< float > px(-16.0f, float(MapWidth * 8));
+		std::uniform_real_distribution< float > py(-16.0f, float(MapHeight * 8));
+		std::vector< TileBox > boxes;
+		boxes.reserve(queries);
+		for (uint32_t i = 0; i < queries; ++i) {
+			boxes.emplace_back(tile_box(glm::vec2(px(mt), py(mt)), glm::vec2(16.0f, 16.0f)));
+		}
+
+		//check the paths agree:
+		uint32_t hits = 0;
+		for (auto const &box : boxes) {
+			bool expected = collides_list(walls, box);
+			bool got = world.any_solid(box.left, box.bottom, box.right, box.top);
+			if (expected != got) {
+				std::cout << "  MISMATCH at tiles [" << box.left << "," << box.right << "]x[" << box.bottom << "," << box.top << "]: list says "
+					<< expected << ", map says " << got << '\n';
+				ok = false;
+				break;
+			}
+			hits += (got ? 1 : 0);
+		}
+
+		//time them (counting hits so the work isn't optimized away):
+		uint32_t list_hits = 0;
+		double list_ms = time_ms([&](){
+			for (auto const &box : boxes) list_hits += (collides_list(walls, box) ? 1 : 0);
+		});
+		uint32_t map_hits = 0;
+		//(the map path is fast enough to need more repetitions for a stable time)
+		constexpr uint32_t MapRepeats = 100;
+		double map_ms = time_ms([&](){
+			for (uint32_t r = 0; r < MapRepeats; ++r) {
+				for (auto const &box : boxes) map_hits += (world.any_solid(box.left, box.bottom, box.right, box.top) ? 1 : 0);
+			}
+		}) / MapRepeats;
+		if (list_hits != hits || map_hits != hits * MapRepeats) ok = false;
+
+		double list_ns = list_ms * 1.0e6 / queries;
+		double map_ns = map_ms * 1.0e6 / queries;
+		std::cout << "  " << std::left << std::setw(10) << density << std::right
+			<< std::setw(8) << walls.size() << std::setw(8) << hits
+			<< std::fixed << std::setprecision(1)
+			<< std::setw(14) << list_ns << std::setw(14) << map_ns << std::setw(9) << list_ns / map_ns << "x" << '\n';
+		std::cout.unsetf(std::ios::fixed);
+		std::cout << std::setprecision(6);
+	}
+	std::cout.flush();
+
+	return ok;
+}
+
+//------------ proximity ------------
+
+static bool run_proximity(uint32_t queries) {
+	bool ok = true;
+
+	//the whole background, with cells the size of PlayMode's largest query radius:
+	glm::vec2 const Area = glm::vec2(PPU466::BackgroundWidth * 8, PPU466::BackgroundHeight * 8);
+	constexpr float Radius = 8.0f; //(PlayMode's enemy collision distance)
+
+	std::cout << "\nproximity (radius " << Radius << "; grid times include clearing, inserting, and building each tick):\n";
+	std::cout << "  " << std::left << std::setw(10) << "hazards" << std::right
+		<< std::setw(16) << "scan us/tick" << std::setw(16) << "grid us/tick"
+		<< std::setw(16) << "scan us/pairs" << std::setw(16) << "grid us/pairs" << '\n';
+
+	for (uint32_t count : {64u, 256u, 1024u, 4096u}) {
+		std::mt19937 mt(0x466);
+		std::uniform_real_distribution< float > px(0.0f, Area.x);
+		std::uniform_real_distribution< float > py(0.0f, Area.y);
+
+		std::vector< glm::vec2 > hazards;
+		for (uint32_t i = 0; i < count; ++i) {
+			hazards.emplace_back(px(mt), py(mt));
+		}
+		//one player position per tick:
+		uint32_t const ticks = std::max(1u, queries / 100);
+		std::vector< glm::vec2 > players;
+		for (uint32_t t = 0; t < ticks; ++t) {
+			players.emplace_back(px(mt), py(mt));
+		}
+
+		SpatialGrid grid(glm::vec2(0.0f), Area, 16.0f);
+
+		//--- player vs. hazards (what PlayMode::check_enemy_collisions does each tick) ---
+
+		//the scan PlayMode used before SpatialGrid:
+		auto scan_near = [&](glm::vec2 const &at) {
+			uint32_t near = 0;
+			for (auto const &hazard : hazards) {
+				if (glm::length(at - hazard) <= Radius) near += 1;
+			}
+			return near;
+		};
+		auto grid_near = [&](glm::vec2 const &at) {
+			uint32_t near = 0;
+			grid.for_each_within(at, Radius, [&near](uint32_t, glm::vec2 const &){ near += 1; return false; });
+			return near;
+		};
+		auto build_grid = [&]() {
+			grid.clear();
+			for (uint32_t i = 0; i < hazards.size(); ++i) {
+				grid.insert(i, hazards[i]);
+			}
+			grid.build();
+		};
+
+		//check the paths agree:
+		build_grid();
+		for (auto const &at : players) {
+			if (scan_near(at) != grid_near(at)) {
+				std::cout << "  MISMATCH near (" << at.x << ", " << at.y << ") with " << count << " hazards.\n";
+				ok = false;
+				break;
+			}
+		}
+
+		uint64_t scan_total = 0;
+		double scan_ms = time_ms([&](){
+			for (auto const &at : players) scan_total += scan_near(at);
+		});
+		uint64_t grid_total = 0;
+		double grid_ms = time_ms([&](){
+			for (auto const &at : players) {
+				build_grid();
+				grid_total += grid_near(at);
+			}
+		});
+		if (scan_total != grid_total) ok = false;
+
+		//--- every hazard vs. every other hazard (one tick) ---
+
+		uint64_t scan_pairs = 0;
+		double scan_pairs_ms = time_ms([&](){
+			for (auto const &hazard : hazards) scan_pairs += scan_near(hazard);
+		});
+		uint64_t grid_pairs = 0;
+		double grid_pairs_ms = time_ms([&](){
+			build_grid();
+			for (auto const &hazard : hazards) grid_pairs += grid_near(hazard);
+		});
+		if (scan_pairs != grid_pairs) {
+			std::cout << "  MISMATCH in pair count with " << count << " hazards: scan found " << scan_pairs << ", grid found " << grid_pairs << ".\n";
+			ok = false;
+		}
+
+		std::cout << "  " << std::left << std::setw(10) << count << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(16) << scan_ms * 1000.0 / ticks << std::setw(16) << grid_ms * 1000.0 / ticks
+			<< std::setw(16) << scan_pairs_ms * 1000.0 << std::setw(16) << grid_pairs_ms * 1000.0 << '\n';
+		std::cout.unsetf(std::ios::fixed);
+		std::cout << std::setprecision(6);
+	}
+	std::cout.flush();
+
+	return ok;
+}
+
+//------------ patrol ------------
+
+//the enemy update PlayMode used before Patrols (one struct per enemy, branching on direction):
+struct PingPong {
+	glm::vec2 position;
+	glm::vec2 start_position;
+	glm::vec2 move_direction;
+	float path_distance;
+	float current_distance = 0.0f;
+	bool moving_forward = true;
+};
+static void step_ping_pong(std::vector< PingPong > &enemies, float distance_this_frame) {
+	for (auto &enemy : enemies) {
+		if (enemy.path_distance > 0.0f) {
+			if (enemy.moving_forward) {
+				enemy.current_distance += distance_this_frame;
+				enemy.position += enemy.move_direction * distance_this_frame;
+				if (enemy.current_distance >= enemy.path_distance) {
+					enemy.moving_forward = false;
+					enemy.current_distance = enemy.path_distance;
+					enemy.position = enemy.start_position + enemy.move_direction * enemy.path_distance;
+				}
+			} else {
+				enemy.current_distance -= distance_this_frame;
+				enemy.position -= enemy.move_direction * distance_this_frame;
+				if (enemy.current_distance <= 0.0f) {
+					enemy.moving_forward = true;
+					enemy.current_distance = 0.0f;
+					enemy.position = enemy.start_position;
+				}
+			}
+		}
+	}
+}
+
+static bool run_patrol() {
+	bool ok = true;
+
+	constexpr uint32_t Count = 100000;
+	constexpr uint32_t Frames = 600; //ten seconds at 60 fps
+	constexpr float Elapsed = 1.0f / 60.0f;
+	constexpr double BudgetMs = 1.0;
+
+	//random patrols like the level's: a few stationary, the rest along an axis or a diagonal.
+	// Path lengths are multiples of the half-pixel moved per frame, so the old update (which
+	// drops any overshoot when it turns around) lands exactly on the ends and should agree:
+	std::mt19937 mt(0x466);
+	std::uniform_real_distribution< float > px(0.0f, 512.0f);
+	std::uniform_real_distribution< float > py(0.0f, 480.0f);
+	std::uniform_int_distribution< int > kind(0, 4);
+	std::uniform_int_distribution< int > steps(0, 64);
+	glm::vec2 const Directions[] = { glm::vec2(0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(0.0f, 1.0f), glm::vec2(-1.0f, 0.0f), glm::vec2(1.0f, 1.0f) };
+
+	Patrols patrols;
+	std::vector< PingPong > ping_pongs;
+	ping_pongs.reserve(Count);
+	for (uint32_t i = 0; i < Count; ++i) {
+		glm::vec2 start = glm::vec2(px(mt), py(mt));
+		glm::vec2 direction = Directions[kind(mt)];
+		float length = (direction == glm::vec2(0.0f) ? 0.0f : 0.5f * float(steps(mt)));
+		patrols.add(start, direction, length);
+		PingPong enemy;
+		enemy.position = enemy.start_position = start;
+		enemy.move_direction = (length > 0.0f ? glm::normalize(direction) : glm::vec2(0.0f));
+		enemy.path_distance = length;
+		ping_pongs.emplace_back(enemy);
+	}
+	Patrols const initial = patrols;
+	std::vector< PingPong > const initial_ping_pongs = ping_pongs;
+
+	//check the old update against the scalar kernel (diagonals accumulate rounding in the old update, hence the tolerance):
+	set_patrol_kernel(PatrolKernel::Scalar);
+	for (uint32_t f = 0; f < Frames; ++f) {
+		step_ping_pong(ping_pongs, patrols.speed * Elapsed);
+		patrols.step(Elapsed);
+	}
+	Patrols const reference = patrols;
+	for (uint32_t i = 0; i < Count; ++i) {
+		glm::vec2 d = ping_pongs[i].position - reference.position(i);
+		if (std::abs(d.x) > 0.01f || std::abs(d.y) > 0.01f) {
+			std::cout << "  MISMATCH for patrol " << i << " (length " << reference.length[i] << "): ping-pong at ("
+				<< ping_pongs[i].position.x << ", " << ping_pongs[i].position.y << "), Patrols at (" << reference.x[i] << ", " << reference.y[i] << ")\n";
+			ok = false;
+			break;
+		}
+	}
+
+	std::cout << "\npatrol (" << Count << " hazards, " << Frames << " frames; budget " << BudgetMs << " ms/frame):\n";
+	std::cout << "  " << std::left << std::setw(16) << "update" << std::right << std::setw(12) << "ms/frame" << std::setw(12) << "ns/hazard" << "\n";
+	auto report = [&](std::string const &name, double ms) {
+		double per_frame = ms / Frames;
+		std::cout << "  " << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(12) << per_frame << std::setw(12) << per_frame * 1.0e6 / Count
+			<< (per_frame <= BudgetMs ? "" : "  (over budget)") << '\n';
+		std::cout.unsetf(std::ios::fixed);
+		std::cout << std::setprecision(6);
+	};
+
+	ping_pongs = initial_ping_pongs;
+	report("ping-pong", time_ms([&](){
+		for (uint32_t f = 0; f < Frames; ++f) step_ping_pong(ping_pongs, 30.0f * Elapsed);
+	}));
+
+	PatrolKernel const previous = patrol_kernel();
+	for (PatrolKernel kernel : { PatrolKernel::Scalar, PatrolKernel::SSE2, PatrolKernel::AVX2 }) {
+		if (!set_patrol_kernel(kernel)) continue;
+		patrols = initial;
+		double ms = time_ms([&](){
+			for (uint32_t f = 0; f < Frames; ++f) patrols.step(Elapsed);
+		});
+		//every kernel does the same float math, so positions should match the scalar ones exactly:
+		if (patrols.x != reference.x || patrols.y != reference.y || patrols.phase != reference.phase) {
+			std::cout << "  MISMATCH: " << patrol_kernel_name(kernel) << " kernel disagrees with scalar kernel.\n";
+			ok = false;
+		}
+		report(std::string("Patrols/") + patrol_kernel_name(kernel), ms);
+	}
+	set_patrol_kernel(previous);
+	std::cout.flush();
+
+	return ok;
+}
+
+//------------ main ------------
+
+int main(int argc, char **argv) {
+	uint32_t queries = 20000;
+	std::vector< std::string > selected;
+
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--queries" && argi + 1 < argc) {
+			queries = uint32_t(std::max(1, std::stoi(argv[++argi])));
+		} else if (arg.size() > 0 && arg[0] != '-') {
+			selected.emplace_back(arg);
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--queries N] [benchmark ...]" << std::endl;
+			return 1;
+		}
+	}
+
+	struct Benchmark {
+		std::string name;
+		std::function< bool() > run; //returns false if a fast path disagreed with its reference
+	};
+	std::vector< Benchmark > benchmarks{
+		{"collision", [&](){ return run_collision(queries); }},
+		{"proximity", [&](){ return run_proximity(queries); }},
+		{"patrol", [&](){ return run_patrol(); }},
+	};
+
+	for (auto const &name : selected) {
+		if (std::find_if(benchmarks.begin(), benchmarks.end(), [&](Benchmark const &b){ return b.name == name; }) == benchmarks.end()) {
+			std::cerr << "Unknown benchmark '" << name << "'." << std::endl;
+			return 1;
+		}
+	}
+
+	bool ok = true;
+	for (auto const &benchmark : benchmarks) {
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), benchmark.name) == selected.end()) continue;
+		if (!benchmark.run()) ok = false;
+	}
+
+	if (!ok) {
+		std::cout << "\nFAILED: some fast path disagreed with its reference." << std::endl;
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,407 @@
+//game-headless steps PlayMode's simulation as fast as it will go (no window, no GL),
+// driving it with scripted input, and reports how fast it ran and how often it allocated.
+//
+// usage:
+//   game-headless [--level FILE] [--ticks N] [--tick-rate HZ] [--seed S] [--script FILE] [--ppu] [--record-input FILE]
+//   game-headless [--level FILE] --games N [--threads T] [--ticks N] [--tick-rate HZ] [--seed S] [--script FILE]
+//   game-headless [--level FILE] --replay FILE
+//
+//   --level FILE    level to play, as in the game's '--level' (default level1.levl)
+//   --ticks N       number of update() calls to make (default 100000)
+//   --tick-rate HZ  simulated ticks per second, as in the game's '--tick-rate' (default 60)
+//   --seed S        seed for the random input used when there is no script (default 1)
+//   --script FILE   read input from FILE instead; each line is
+//                     TICK BUTTON down|up
+//                   with BUTTON one of left, right, up, down, action ('#' starts a comment)
+//   --ppu           also run PlayMode::update_ppu (the CPU side of drawing) after every tick, and check
+//                   that the background ring holds the world tiles the camera sees
+//   --record-input FILE  save the input of every tick as the game's '--record-input' does
+//
+//When the game ends, it is restarted (as if 'R' were pressed) and the run continues.
+//
+//With '--replay FILE', input recorded by the game (or by '--record-input' above) is played back
+// instead, running update and update_ppu once per tick; the time each tick took is reported
+// as a histogram, and the final state is checked against the recording's.
+//
+//With '--games N', N independent games are run instead, spread over T threads (default: all cores)
+// by a work-stealing pool. Each lasts until game over or N ticks (default 36000, ten minutes);
+// game i uses random input seeded with S + i (or, with '--script', they all use the script).
+// Survival time, flowers grown, and hits taken are then summarized over all the games.
+
+#include "PlayMode.hpp"
+#include "work_stealing.hpp"
+#include "frame_times.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//------------ allocation counting ------------
+
+//every 'new' in the program goes through these, so allocations can be counted per tick:
+static std::atomic< uint64_t > allocations{0};
+
+void *operator new(std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+//------------ scripted input ------------
+
+struct InputEvent {
+	uint64_t tick; //applied just before this tick's update()
+	PlayMode::Button PlayMode::*button;
+	bool down;
+};
+
+static PlayMode::Button PlayMode::*button_named(std::string const &name) {
+	if (name == "left") return &PlayMode::left;
+	if (name == "right") return &PlayMode::right;
+	if (name == "up") return &PlayMode::up;
+	if (name == "down") return &PlayMode::down;
+	if (name == "action") return &PlayMode::action;
+	return nullptr;
+}
+
+static std::vector< InputEvent > read_script(std::string const &filename) {
+	std::ifstream in(filename);
+	if (!in) throw std::runtime_error("Failed to open script '" + filename + "'.");
+
+	std::vector< InputEvent > events;
+	std::string line;
+	for (uint32_t line_number = 1; std::getline(in, line); ++line_number) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream words(line);
+		uint64_t tick;
+		std::string button, state;
+		if (!(words >> tick)) continue; //(blank line)
+		if (!(words >> button >> state) || !button_named(button) || (state != "down" && state != "up")) {
+			throw std::runtime_error(filename + ":" + std::to_string(line_number) + ": expected 'TICK BUTTON down|up'.");
+		}
+		events.emplace_back(InputEvent{tick, button_named(button), state == "down"});
+	}
+	std::stable_sort(events.begin(), events.end(), [](InputEvent const &a, InputEvent const &b){ return a.tick < b.tick; });
+	return events;
+}
+
+//a player who wanders about: every so often, hold a new direction (or none), sometimes pressing 'A':
+static std::vector< InputEvent > random_script(uint64_t ticks, uint32_t seed) {
+	std::mt19937 mt(seed);
+	std::uniform_int_distribution< uint64_t > hold(10, 60);
+	std::uniform_int_distribution< int > axis(-1, 1);
+	std::uniform_int_distribution< int > chance(0, 3);
+
+	std::vector< InputEvent > events;
+	int x = 0, y = 0;
+	for (uint64_t tick = 0; tick < ticks; tick += hold(mt)) {
+		int new_x = axis(mt);
+		int new_y = axis(mt);
+		if (new_x != x) {
+			if (x < 0) events.emplace_back(InputEvent{tick, &PlayMode::left, false});
+			if (x > 0) events.emplace_back(InputEvent{tick, &PlayMode::right, false});
+			if (new_x < 0) events.emplace_back(InputEvent{tick, &PlayMode::left, true});
+			if (new_x > 0) events.emplace_back(InputEvent{tick, &PlayMode::right, true});
+			x = new_x;
+		}
+		if (new_y != y) {
+			if (y < 0) events.emplace_back(InputEvent{tick, &PlayMode::down, false});
+			if (y > 0) events.emplace_back(InputEvent{tick, &PlayMode::up, false});
+			if (new_y < 0) events.emplace_back(InputEvent{tick, &PlayMode::down, true});
+			if (new_y > 0) events.emplace_back(InputEvent{tick, &PlayMode::up, true});
+			y = new_y;
+		}
+		if (chance(mt) == 0) {
+			events.emplace_back(InputEvent{tick, &PlayMode::action, true});
+			events.emplace_back(InputEvent{tick + 1, &PlayMode::action, false});
+		}
+	}
+	return events;
+}
+
+//apply events for 'tick' (starting at events[*next_event]) as PlayMode::handle_event would record them:
+static void apply_input(std::vector< InputEvent > const &events, size_t *next_event, uint64_t tick, PlayMode *play) {
+	for (; *next_event < events.size() && events[*next_event].tick <= tick; ++*next_event) {
+		PlayMode::Button &button = play->*(events[*next_event].button);
+		if (events[*next_event].down) {
+			button.downs += 1;
+			button.pressed = 1;
+		} else {
+			button.pressed = 0;
+		}
+	}
+}
+
+//------------ batch ------------
+
+struct GameResult {
+	uint64_t ticks = 0; //ticks survived
+	bool died = false; //(otherwise, ran out of ticks)
+	uint32_t flowers_grown = 0;
+	uint32_t hits_taken = 0;
+	bool operator==(GameResult const &) const = default;
+};
+
+static int run_batch(std::string const &level_file, uint32_t games, uint32_t threads, uint64_t ticks, float elapsed, uint32_t seed, std::string const &script_path) {
+	//everything shared between games is loaded up front and only read from then on:
+	PlayData const data = PlayData::load(level_file);
+	std::vector< InputEvent > const script = (script_path.empty() ? std::vector< InputEvent >() : read_script(script_path));
+
+	std::vector< GameResult > results(games);
+
+	auto before = std::chrono::high_resolution_clock::now();
+	uint64_t steals = run_work_stealing(games, threads, [&](uint32_t game, uint32_t) {
+		std::vector< InputEvent > const random = (script_path.empty() ? random_script(ticks, seed + game) : std::vector< InputEvent >());
+		std::vector< InputEvent > const &events = (script_path.empty() ? random : script);
+
+		PlayMode play(data);
+		play.verbose = false;
+
+		//(results are written once at the end, so threads don't share cache lines while playing)
+		GameResult result;
+		size_t next_event = 0;
+		for (uint64_t tick = 0; tick < ticks && !play.game_over; ++tick) {
+			apply_input(events, &next_event, tick, &play);
+			play.update(elapsed);
+			result.ticks += 1;
+		}
+		result.died = play.game_over;
+		result.flowers_grown = play.flowers_grown;
+		result.hits_taken = play.hits_taken;
+		results[game] = result;
+	});
+	auto after = std::chrono::high_resolution_clock::now();
+	double const seconds = std::chrono::duration< double >(after - before).count();
+
+	//summarize:
+	uint64_t total_ticks = 0, total_flowers = 0, total_hits = 0;
+	uint32_t died = 0, max_flowers = 0;
+	std::vector< uint64_t > survival;
+	survival.reserve(games);
+	for (auto const &result : results) {
+		total_ticks += result.ticks;
+		total_flowers += result.flowers_grown;
+		total_hits += result.hits_taken;
+		died += (result.died ? 1 : 0);
+		max_flowers = std::max(max_flowers, result.flowers_grown);
+		survival.emplace_back(result.ticks);
+	}
+	std::sort(survival.begin(), survival.end());
+	double const tick_seconds = double(elapsed);
+
+	std::cout << "Ran " << games << " games (up to " << ticks << " ticks each) on "
+		<< std::min(games, (threads ? threads : std::max(1u, std::thread::hardware_concurrency()))) << " threads in " << seconds << " s (" << steals << " steals):\n";
+	std::cout << std::fixed << std::setprecision(0)
+		<< "  " << games / seconds << " games/s, " << total_ticks / seconds << " ticks/s\n";
+	std::cout << std::setprecision(1)
+		<< "  survival: " << died << " of " << games << " died; game time survived (s) min " << survival.front() * tick_seconds
+		<< ", median " << survival[survival.size() / 2] * tick_seconds
+		<< ", mean " << double(total_ticks) / games * tick_seconds
+		<< ", max " << survival.back() * tick_seconds << "\n";
+	std::cout << std::setprecision(2)
+		<< "  flowers grown: mean " << double(total_flowers) / games << ", max " << max_flowers << "\n"
+		<< "  hits taken: mean " << double(total_hits) / games << std::endl;
+
+	if (!script_path.empty()) {
+		//the same script and the same level should always play out the same way:
+		bool same = std::all_of(results.begin(), results.end(), [&](GameResult const &r){ return r == results[0]; });
+		std::cout << "  scripted games " << (same ? "all played out identically." : "DIFFERED (simulation is not deterministic!)") << std::endl;
+		if (!same) return 1;
+	}
+	return 0;
+}
+
+//------------ background check ------------
+
+//number of on-screen tiles where the background ring doesn't hold the world tile the camera should see:
+// (the game-over text is drawn over the background, so this is only meaningful during play)
+static uint32_t view_mismatches(PlayMode const &play) {
+	int32_t const W = int32_t(PPU466::BackgroundWidth), H = int32_t(PPU466::BackgroundHeight);
+	uint32_t mismatches = 0;
+	for (int32_t y = play.camera.y / 8; y < play.camera.y / 8 + BackgroundStreamer::ViewHeight; ++y) {
+		for (int32_t x = play.camera.x / 8; x < play.camera.x / 8 + BackgroundStreamer::ViewWidth; ++x) {
+			if (!play.world->inside(x, y)) continue;
+			if (play.ppu.background[x % W + W * (y % H)] != play.world->tile(x, y)) mismatches += 1;
+		}
+	}
+	return mismatches;
+}
+
+//------------ replay ------------
+
+static int run_replay(std::string const &level_file, std::string const &replay_path) {
+	InputRecording recording;
+	read_input_recording(replay_path, &recording);
+
+	PlayMode play(PlayData::load(level_file));
+	play.verbose = false; //(console output would be timed too)
+	play.start_replay(recording);
+
+	FrameTimes times;
+	times.ms.reserve(recording.header.ticks);
+
+	auto before = std::chrono::high_resolution_clock::now();
+	while (!play.replay_finished()) {
+		auto tick_start = std::chrono::high_resolution_clock::now();
+		play.update(recording.header.tick_elapsed);
+		play.update_ppu(0.0f);
+		times.add(std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - tick_start).count());
+	}
+	auto after = std::chrono::high_resolution_clock::now();
+	double const seconds = std::chrono::duration< double >(after - before).count();
+
+	bool same = (play.state_hash() == recording.header.state_hash);
+	std::cout << "Replayed " << play.tick << " ticks (" << recording.changes.size() << " input changes) from '" << replay_path
+		<< "' in " << seconds << " s; final state " << (same ? "matches the recording." : "DIFFERS from the recording (simulation is not deterministic!)") << "\n";
+	std::cout << "Time per tick (update + update_ppu):\n";
+	times.report(std::cout);
+	std::cout.flush();
+	return same ? 0 : 1;
+}
+
+//------------ main ------------
+
+int main(int argc, char **argv) {
+	uint64_t ticks = 0; //(0 = the default for the mode)
+	double tick_rate = 60.0;
+	uint32_t games = 0;
+	uint32_t threads = 0;
+	uint32_t seed = 1;
+	std::string script_path;
+	bool run_ppu = false;
+	std::string level_file = "level1.levl";
+	std::string record_input_path;
+	std::string replay_path;
+
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--level" && argi + 1 < argc) {
+			level_file = argv[++argi];
+		} else if (arg == "--ticks" && argi + 1 < argc) {
+			ticks = std::stoull(argv[++argi]);
+		} else if (arg == "--tick-rate" && argi + 1 < argc) {
+			tick_rate = std::stod(argv[++argi]);
+		} else if (arg == "--seed" && argi + 1 < argc) {
+			seed = uint32_t(std::stoul(argv[++argi]));
+		} else if (arg == "--script" && argi + 1 < argc) {
+			script_path = argv[++argi];
+		} else if (arg == "--ppu") {
+			run_ppu = true;
+		} else if (arg == "--record-input" && argi + 1 < argc) {
+			record_input_path = argv[++argi];
+		} else if (arg == "--replay" && argi + 1 < argc) {
+			replay_path = argv[++argi];
+		} else if (arg == "--games" && argi + 1 < argc) {
+			games = uint32_t(std::stoul(argv[++argi]));
+		} else if (arg == "--threads" && argi + 1 < argc) {
+			threads = uint32_t(std::stoul(argv[++argi]));
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--level FILE] [--ticks N] [--tick-rate HZ] [--seed S] [--script FILE] [--ppu] [--record-input FILE]\n"
+				<< "\t" << argv[0] << " [--level FILE] --games N [--threads T] [--ticks N] [--tick-rate HZ] [--seed S] [--script FILE]\n"
+				<< "\t" << argv[0] << " [--level FILE] --replay FILE" << std::endl;
+			return 1;
+		}
+	}
+	if (!(tick_rate >= 1.0 && tick_rate <= 1000.0)) {
+		std::cerr << "Tick rate should be between 1 and 1000 Hz." << std::endl;
+		return 1;
+	}
+
+	try {
+		if (!replay_path.empty()) {
+			return run_replay(level_file, replay_path);
+		}
+		if (games > 0) {
+			return run_batch(level_file, games, threads, (ticks ? ticks : 36000), float(1.0 / tick_rate), seed, script_path);
+		}
+		if (ticks == 0) ticks = 100000;
+
+		std::vector< InputEvent > events = (script_path.empty() ? random_script(ticks, seed) : read_script(script_path));
+
+		//(PlayMode only needs GL in draw(), which is never called here)
+		PlayMode play(PlayData::load(level_file));
+		float const elapsed = float(1.0 / tick_rate);
+		if (!record_input_path.empty()) play.start_input_recording();
+
+		uint64_t restarts = 0;
+		uint64_t max_tick_allocations = 0;
+		uint64_t total_streamed = 0; //background entries copied in from the world
+		uint32_t max_streamed = 0; //...in one tick, other than when the ring is (re)filled on (re)start
+		uint64_t background_mismatches = 0;
+		uint64_t const allocations_before = allocations.load();
+		auto before = std::chrono::high_resolution_clock::now();
+
+		size_t next_event = 0;
+		for (uint64_t tick = 0; tick < ticks; ++tick) {
+			uint64_t const tick_start = allocations.load(std::memory_order_relaxed);
+
+			apply_input(events, &next_event, tick, &play);
+
+			play.update(elapsed);
+			if (run_ppu) {
+				bool refill = !play.background_streamer.loaded;
+				play.update_ppu(1.0f);
+				total_streamed += play.tiles_streamed;
+				if (!refill) max_streamed = std::max(max_streamed, play.tiles_streamed);
+				//(every so often, so checking barely affects the timing)
+				if (tick % 64 == 0 && !play.game_over) background_mismatches += view_mismatches(play);
+			}
+
+			if (play.game_over) {
+				play.restart_game();
+				play.restarted = true; //(as handle_event notes it)
+				restarts += 1;
+			}
+
+			max_tick_allocations = std::max(max_tick_allocations, allocations.load(std::memory_order_relaxed) - tick_start);
+		}
+
+		auto after = std::chrono::high_resolution_clock::now();
+		uint64_t const total_allocations = allocations.load() - allocations_before;
+		double const seconds = std::chrono::duration< double >(after - before).count();
+
+		std::cout << "Ran " << ticks << " ticks (" << ticks / tick_rate << " s of game time"
+			<< (run_ppu ? ", with update_ppu" : "") << ") in " << seconds << " s:\n";
+		std::cout << "  " << std::fixed << std::setprecision(0) << ticks / seconds << " ticks/s ("
+			<< std::setprecision(3) << seconds * 1.0e6 / ticks << " us/tick)\n";
+		std::cout << "  " << total_allocations << " allocations (" << std::setprecision(4) << double(total_allocations) / ticks
+			<< " per tick; at most " << max_tick_allocations << " in one tick)\n";
+		std::cout << "  " << restarts << " restarts after game over; player ended at ("
+			<< std::setprecision(2) << play.player_at.x << ", " << play.player_at.y << ") with " << play.player_health << " health" << std::endl;
+		if (run_ppu) {
+			std::cout << "  world " << play.world->width << "x" << play.world->height << " tiles (" << play.world->bytes() << " bytes); streamed "
+				<< std::setprecision(2) << double(total_streamed) / ticks << " background entries per tick (at most " << max_streamed << " outside of refills); "
+				<< background_mismatches << " on-screen tiles didn't match the world" << std::endl;
+		}
+
+		if (!record_input_path.empty()) {
+			play.save_input_recording(record_input_path);
+			std::cout << "  recorded input (" << play.input_recording->changes.size() << " changes) to '" << record_input_path << "'" << std::endl;
+		}
+		if (background_mismatches) return 1;
+	} catch (std::exception const &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
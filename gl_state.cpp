@@ -0,0 +1,132 @@
+#include "gl_state.hpp"
+
+#include <cassert>
+
+GLState gl_state;
+
+//helper: run 'call' (and count a change) if 'current' differs from 'value'; otherwise count a skip:
+#define GL_STATE_SET(current, value, call) \
+	if ((current) == (value)) { \
+		frame.skipped += 1; \
+	} else { \
+		(current) = (value); \
+		call; \
+		frame.changes += 1; \
+	}
+
+void GLState::viewport(glm::ivec4 const &xywh) {
+	if (viewport_known && viewport_ == xywh) {
+		frame.skipped += 1;
+		return;
+	}
+	viewport_known = true;
+	viewport_ = xywh;
+	glViewport(xywh.x, xywh.y, xywh.z, xywh.w);
+	frame.changes += 1;
+}
+
+glm::ivec4 const &GLState::viewport() {
+	if (!viewport_known) {
+		GLint v[4];
+		glGetIntegerv(GL_VIEWPORT, v);
+		viewport_ = glm::ivec4(v[0], v[1], v[2], v[3]);
+		viewport_known = true;
+		frame.queries += 1;
+	}
+	return viewport_;
+}
+
+void GLState::bind_framebuffer(GLenum target, GLuint framebuffer) {
+	if (target == GL_FRAMEBUFFER) {
+		if (draw_framebuffer_ == framebuffer && read_framebuffer_ == framebuffer) {
+			frame.skipped += 1;
+			return;
+		}
+		draw_framebuffer_ = read_framebuffer_ = framebuffer;
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		frame.changes += 1;
+	} else if (target == GL_DRAW_FRAMEBUFFER) {
+		GL_STATE_SET(draw_framebuffer_, framebuffer, glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer));
+	} else {
+		assert(target == GL_READ_FRAMEBUFFER && "framebuffer target is one of the three framebuffer targets");
+		GL_STATE_SET(read_framebuffer_, framebuffer, glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer));
+	}
+}
+
+void GLState::clear_color(glm::vec4 const &color) {
+	if (clear_color_known && clear_color_ == color) {
+		frame.skipped += 1;
+		return;
+	}
+	clear_color_known = true;
+	clear_color_ = color;
+	glClearColor(color.r, color.g, color.b, color.a);
+	frame.changes += 1;
+}
+
+void GLState::use_program(GLuint program_) {
+	GL_STATE_SET(program, program_, glUseProgram(program_));
+}
+
+void GLState::bind_vertex_array(GLuint vertex_array_) {
+	GL_STATE_SET(vertex_array, vertex_array_, glBindVertexArray(vertex_array_));
+}
+
+void GLState::bind_array_buffer(GLuint buffer) {
+	GL_STATE_SET(array_buffer, buffer, glBindBuffer(GL_ARRAY_BUFFER, buffer));
+}
+
+void GLState::active_texture(GLenum unit) {
+	assert(unit >= GL_TEXTURE0 && unit < GL_TEXTURE0 + MaxTextureUnits && "texture unit is tracked");
+	GL_STATE_SET(active_unit, unit, glActiveTexture(unit));
+}
+
+void GLState::bind_texture(GLuint texture) {
+	if (active_unit == Unknown) {
+		//(after invalidate() the active unit is unknown, so make it known before relying on it)
+		active_texture(GL_TEXTURE0);
+	}
+	GL_STATE_SET(texture_2d[active_unit - GL_TEXTURE0], texture, glBindTexture(GL_TEXTURE_2D, texture));
+}
+
+void GLState::blend(bool enabled) {
+	GLuint value = (enabled ? GL_TRUE : GL_FALSE);
+	GL_STATE_SET(blend_enabled, value, (enabled ? glEnable(GL_BLEND) : glDisable(GL_BLEND)));
+}
+
+void GLState::blend_equation(GLenum mode) {
+	GL_STATE_SET(blend_mode, mode, glBlendEquation(mode));
+}
+
+void GLState::blend_func(GLenum sfactor, GLenum dfactor) {
+	if (blend_sfactor == sfactor && blend_dfactor == dfactor) {
+		frame.skipped += 1;
+		return;
+	}
+	blend_sfactor = sfactor;
+	blend_dfactor = dfactor;
+	glBlendFunc(sfactor, dfactor);
+	frame.changes += 1;
+}
+
+void GLState::unpack_row_length(GLint length) {
+	GL_STATE_SET(unpack_row_length_, length, glPixelStorei(GL_UNPACK_ROW_LENGTH, length));
+}
+
+void GLState::invalidate() {
+	viewport_known = false;
+	draw_framebuffer_ = read_framebuffer_ = Unknown;
+	clear_color_known = false;
+
+	program = vertex_array = array_buffer = Unknown;
+	active_unit = Unknown;
+	texture_2d.fill(Unknown);
+
+	blend_enabled = blend_mode = blend_sfactor = blend_dfactor = Unknown;
+	unpack_row_length_ = -1; //(never a valid row length)
+}
+
+void GLState::end_frame() {
+	last_frame = frame;
+	frame = Counts();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <stdint.h>
+
+//GLState keeps a CPU-side copy of the (small) part of OpenGL's state this code changes, so that:
+// - setting state to the value it already has costs nothing (no GL call is made), and
+// - asking what the state is doesn't need a glGet (which can stall the driver).
+//
+//For the copy to stay correct, code that changes any of this state should do so through
+// 'gl_state'. Nothing checks this: PPU466::draw trusts the copy and leaves its bindings in place
+// between frames, so a change made behind gl_state's back shows up as wrong textures or programs.
+//Code that can't go through 'gl_state' (e.g., a library, or a loader calling GL directly) must be
+// followed by gl_state.invalidate() before the next gl_state user runs. In particular, call it:
+// - once the context is created and the assets are loaded (i.e., after call_load_functions()),
+// - after any other code that binds or enables anything directly (e.g., a Mode's draw() that
+//   doesn't use gl_state), before the PPU draws again.
+//
+//The copy starts out holding the defaults of a freshly-created context, except for the
+// viewport, which is read back the first time it is asked for (if it hasn't been set first).
+struct GLState {
+	//--- framebuffers + viewport ---
+	void viewport(glm::ivec4 const &xywh);
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height) { viewport(glm::ivec4(x, y, width, height)); }
+	glm::ivec4 const &viewport();
+
+	//target may be GL_FRAMEBUFFER (both), GL_DRAW_FRAMEBUFFER, or GL_READ_FRAMEBUFFER:
+	void bind_framebuffer(GLenum target, GLuint framebuffer);
+	GLuint draw_framebuffer() const { return draw_framebuffer_; }
+	GLuint read_framebuffer() const { return read_framebuffer_; }
+
+	void clear_color(glm::vec4 const &color);
+
+	//--- pipeline ---
+	void use_program(GLuint program);
+	void bind_vertex_array(GLuint vertex_array);
+	void bind_array_buffer(GLuint buffer);
+
+	//like glActiveTexture, 'unit' is GL_TEXTURE0 + n:
+	void active_texture(GLenum unit);
+	//binds a GL_TEXTURE_2D texture to the active unit:
+	void bind_texture(GLuint texture);
+
+	void blend(bool enabled);
+	void blend_equation(GLenum mode);
+	void blend_func(GLenum sfactor, GLenum dfactor);
+
+	//GL_UNPACK_ROW_LENGTH (0 means "rows are tightly packed"):
+	void unpack_row_length(GLint length);
+
+	//forget everything; every setter will make its GL call at least once more:
+	void invalidate();
+
+	//--- counters ---
+	struct Counts {
+		uint32_t changes = 0; //GL calls made because state actually changed
+		uint32_t skipped = 0; //calls skipped because the state already had that value
+		uint32_t queries = 0; //glGet calls made (only after invalidate() or before a value was ever set)
+	};
+	Counts frame; //counts so far this frame
+	Counts last_frame; //counts for the previous frame
+
+	//call once per frame (e.g., just after swapping buffers) to move 'frame' to 'last_frame':
+	void end_frame();
+
+private:
+	//'Unknown' is a value that never matches a real setting, so the next set always goes through:
+	static constexpr GLuint Unknown = ~GLuint(0);
+	static constexpr uint32_t MaxTextureUnits = 16;
+
+	bool viewport_known = false;
+	glm::ivec4 viewport_ = glm::ivec4(0);
+	GLuint draw_framebuffer_ = 0;
+	GLuint read_framebuffer_ = 0;
+	bool clear_color_known = true;
+	glm::vec4 clear_color_ = glm::vec4(0.0f);
+
+	GLuint program = 0;
+	GLuint vertex_array = 0;
+	GLuint array_buffer = 0;
+	GLenum active_unit = GL_TEXTURE0;
+	std::array< GLuint, MaxTextureUnits > texture_2d{}; //binding of each unit
+
+	GLuint blend_enabled = GL_FALSE;
+	GLenum blend_mode = GL_FUNC_ADD;
+	GLenum blend_sfactor = GL_ONE;
+	GLenum blend_dfactor = GL_ZERO;
+
+	GLint unpack_row_length_ = 0;
+};
+
+//the state of the (one) OpenGL context this program uses:
+extern GLState gl_state;
@@ -0,0 +1,50 @@
+#include "input_record.hpp"
+#include "read_write_chunk.hpp"
+
+#include <cassert>
+#include <fstream>
+#include <stdexcept>
+
+void InputRecording::add(InputTick const &input) {
+	assert(changes.empty() || changes.back().tick < input.tick);
+	uint8_t held = (changes.empty() ? 0 : changes.back().pressed);
+	if (input.pressed == held && input.downs == 0 && input.flags == 0) return;
+	changes.emplace_back(input);
+}
+
+InputTick InputRecording::at(uint32_t tick, size_t *next) const {
+	assert(next);
+	if (*next < changes.size() && changes[*next].tick == tick) {
+		return changes[(*next)++];
+	}
+	//nothing changed, so the buttons are as they were:
+	InputTick input;
+	input.tick = tick;
+	if (*next > 0) input.pressed = changes[*next - 1].pressed;
+	return input;
+}
+
+void read_input_recording(std::string const &filename, InputRecording *recording) {
+	assert(recording);
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) throw std::runtime_error("Failed to open input recording '" + filename + "'.");
+
+	std::vector< InputRecordingHeader > headers;
+	read_chunk(file, "INPH", &headers);
+	if (headers.size() != 1) throw std::runtime_error("Expected one header in '" + filename + "', found " + std::to_string(headers.size()) + ".");
+	recording->header = headers[0];
+
+	read_chunk(file, "INPT", &recording->changes);
+	for (size_t i = 0; i < recording->changes.size(); ++i) {
+		if ((i > 0 && recording->changes[i].tick <= recording->changes[i-1].tick) || recording->changes[i].tick >= recording->header.ticks) {
+			throw std::runtime_error("Input recording '" + filename + "' has ticks out of order.");
+		}
+	}
+}
+
+void write_input_recording(std::string const &filename, InputRecording const &recording) {
+	std::ofstream file(filename, std::ios::binary);
+	write_chunk("INPH", std::vector< InputRecordingHeader >{ recording.header }, &file);
+	write_chunk("INPT", recording.changes, &file);
+	if (!file) throw std::runtime_error("Failed to write input recording '" + filename + "'.");
+}
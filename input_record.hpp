@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Recording of the player's input, tick by tick, for deterministic replays.
+ *
+ * The simulation runs in fixed ticks (see '--tick-rate' in main.cpp) and only reads input
+ * through PlayMode's buttons, so the buttons' state at every tick (plus when 'R' restarted
+ * the game) is enough to play a session out again exactly.
+ *
+ * Only ticks where something changed are stored, eight bytes each. A recording file is:
+ *  'INPH' -- one InputRecordingHeader
+ *  'INPT' -- the InputTick entries, in tick order
+ * (chunks as in read_write_chunk.hpp; values are native-endian)
+ */
+
+//bits of InputTick::pressed and ::downs:
+struct InputButtons {
+	enum : uint8_t {
+		Left = 0x01,
+		Right = 0x02,
+		Up = 0x04,
+		Down = 0x08,
+		Action = 0x10,
+	};
+};
+
+//input as the simulation sees it at the start of one tick:
+struct InputTick {
+	enum : uint8_t {
+		Restart = 0x01, //the game was restarted just before this tick
+	};
+	uint32_t tick = 0; //update() call this is for (the first is tick 0)
+	uint8_t pressed = 0; //buttons held
+	uint8_t downs = 0; //buttons pressed since the previous tick (a button pressed twice in one tick counts once -- PlayMode only checks for any)
+	uint8_t flags = 0;
+	uint8_t unused = 0;
+};
+static_assert(sizeof(InputTick) == 8, "InputTick is packed");
+
+struct InputRecordingHeader {
+	float tick_elapsed = 0.0f; //seconds per tick the recording was made at
+	uint32_t ticks = 0; //ticks recorded
+	uint64_t state_hash = 0; //PlayMode::state_hash() after the last tick (so replays can check they match)
+};
+static_assert(sizeof(InputRecordingHeader) == 16, "InputRecordingHeader is packed");
+
+struct InputRecording {
+	InputRecordingHeader header;
+	std::vector< InputTick > changes; //ticks where anything differs from the tick before
+
+	//note the input of the next tick (ticks must be added in order):
+	void add(InputTick const &input);
+
+	//input for 'tick', with *next the index of the first change not yet played:
+	// (for playing back in tick order, starting from *next = 0)
+	InputTick at(uint32_t tick, size_t *next) const;
+};
+
+//throw on failure:
+void read_input_recording(std::string const &filename, InputRecording *recording);
+void write_input_recording(std::string const &filename, InputRecording const &recording);
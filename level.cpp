@@ -0,0 +1,101 @@
+#include "level.hpp"
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <stdexcept>
+
+void compile_level_text(std::vector< std::string > const &rows, LevelData *level_, WorldMap *world) {
+	assert(level_);
+	assert(world);
+	LevelData &level = *level_;
+	level = LevelData();
+
+	//at least a screen, so the camera never looks past the edge of the world:
+	uint32_t width = PPU466::ScreenWidth / 8;
+	uint32_t height = std::max(uint32_t(rows.size()), uint32_t(PPU466::ScreenHeight / 8));
+	for (auto const &row : rows) {
+		width = std::max(width, uint32_t(row.size()));
+	}
+	if (width > WorldMap::MaxSize || height > WorldMap::MaxSize) {
+		throw std::runtime_error("Level is " + std::to_string(width) + "x" + std::to_string(height) + " tiles; at most " + std::to_string(WorldMap::MaxSize) + " on a side fit.");
+	}
+
+	//window pattern behind everything (palette 1):
+	uint16_t const WindowPattern[4][4] = {
+		{ 4,  5,  6,  7},
+		{20, 21, 22, 23},
+		{36, 37, 38, 39},
+		{52, 53, 54, 55}
+	};
+	std::vector< uint16_t > tiles(size_t(width) * height);
+	std::vector< uint8_t > solid(size_t(width) * height, 0);
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			tiles[x + size_t(width) * y] = uint16_t(WindowPattern[y % 4][x % 4] | (1 << 8));
+		}
+	}
+
+	auto spawn = [&](LevelSpawn const &s) {
+		if (level.spawn_count == LevelData::MaxSpawns) {
+			throw std::runtime_error("Level has more than " + std::to_string(LevelData::MaxSpawns) + " spawns.");
+		}
+		level.spawns[level.spawn_count++] = s;
+	};
+
+	//the first row is the top of the level:
+	int32_t const map_height = int32_t(rows.size());
+	for (int32_t row = 0; row < map_height; ++row) {
+		std::string const &line = rows[row];
+		for (int32_t col = 0; col < int32_t(line.size()); ++col) {
+			int32_t x = col;
+			int32_t y = map_height - 1 - row;
+
+			LevelSpawn s;
+			s.x = int16_t(x * 8);
+			s.y = int16_t(y * 8);
+			switch (line[col]) {
+				case '#': //wall: solid, and drawn as wood (tile 24, palette 4)
+					solid[x + size_t(width) * y] = 1;
+					tiles[x + size_t(width) * y] = uint16_t(24 | (4 << 8));
+					break;
+				case 'E': s.kind = LevelSpawn::Enemy; spawn(s); break;
+				case 'L': s.kind = LevelSpawn::Enemy; s.dx = 1; s.length = 32; spawn(s); break;
+				case 'U': s.kind = LevelSpawn::Enemy; s.dy = 1; s.length = 24; spawn(s); break;
+				case 'H': s.kind = LevelSpawn::Heart; spawn(s); break;
+				case 'P': s.kind = LevelSpawn::Pot; spawn(s); break;
+				case 'F': s.kind = LevelSpawn::Flower; spawn(s); break;
+				default: break;
+			}
+		}
+	}
+
+	world->build(width, height, tiles, solid);
+}
+
+void read_level(std::string const &filename, LevelData *level, WorldMap *world) {
+	assert(level);
+	assert(world);
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) throw std::runtime_error("Failed to open level '" + filename + "'.");
+
+	std::vector< LevelData > levels;
+	read_chunk(file, "LEVL", &levels);
+	if (levels.size() != 1) throw std::runtime_error("Expected one level in '" + filename + "', found " + std::to_string(levels.size()) + ".");
+	if (levels[0].spawn_count > LevelData::MaxSpawns) throw std::runtime_error("Level '" + filename + "' has an invalid spawn count.");
+	*level = levels[0];
+
+	try {
+		read_world_map(file, world);
+	} catch (std::exception const &e) {
+		throw std::runtime_error("Level '" + filename + "': " + e.what());
+	}
+}
+
+void write_level(std::string const &filename, LevelData const &level, WorldMap const &world) {
+	std::ofstream file(filename, std::ios::binary);
+	write_chunk("LEVL", std::vector< LevelData >{ level }, &file);
+	write_world_map(world, &file);
+	if (!file) throw std::runtime_error("Failed to write level '" + filename + "'.");
+}
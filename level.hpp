@@ -0,0 +1,54 @@
+#pragma once
+
+#include "PPU466.hpp"
+#include "world_map.hpp"
+
+#include <array>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+
+//A level as compiled by build_level: its spawns, in a "LEVL" chunk, followed by its
+// tiles as a WorldMap (see world_map.hpp).
+//LevelData is fixed-size, so loading (and reloading, on restart) is a single copy; the
+// world map is only read from once loaded, so games can share it.
+
+//something placed in the level when it starts:
+struct LevelSpawn {
+	enum Kind : uint8_t {
+		Enemy = 0, //patrols 'length' pixels along (dx,dy) (stationary if length is zero)
+		Heart = 1,
+		Pot = 2,
+		Flower = 3,
+	};
+	uint8_t kind = Enemy;
+	int8_t dx = 0, dy = 0; //patrol direction (enemies only)
+	uint8_t length = 0; //patrol length in pixels (enemies only)
+	int16_t x = 0, y = 0; //position in pixels, (0,0) at the bottom left
+};
+static_assert(sizeof(LevelSpawn) == 8, "LevelSpawn is packed");
+
+struct LevelData {
+	enum : uint32_t {
+		MaxSpawns = 256
+	};
+
+	uint32_t spawn_count = 0;
+	uint32_t unused = 0;
+	std::array< LevelSpawn, MaxSpawns > spawns{}; //[0,spawn_count) are used
+};
+static_assert(std::is_trivially_copyable_v< LevelData >, "LevelData is stored as raw bytes");
+
+//build a level from a text map, one character per tile, top row first:
+//  '#' wall   'E' stationary enemy   'L' enemy patrolling left/right   'U' enemy patrolling up/down
+//  'H' heart  'P' pot                'F' flower                        anything else: empty
+// The world is as wide as the longest row and as tall as the map, and at least a screen in
+// each direction (shorter rows and small maps are filled with empty tiles).
+// (throws on more than MaxSpawns spawns or a map larger than WorldMap::MaxSize)
+void compile_level_text(std::vector< std::string > const &rows, LevelData *level, WorldMap *world);
+
+//read the "LEVL" and world chunks written by build_level (throws on error):
+void read_level(std::string const &filename, LevelData *level, WorldMap *world);
+//write 'level' as a "LEVL" chunk followed by 'world':
+void write_level(std::string const &filename, LevelData const &level, WorldMap const &world);
@@ -10,8 +10,14 @@
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
-//for screenshots:
-#include "load_save_png.hpp"
+//gl_state tracks GL state so redundant changes (and glGet queries) can be skipped:
+#include "gl_state.hpp"
+
+//for screenshots and continuous capture:
+#include "frame_capture.hpp"
+
+//for replay timing:
+#include "frame_times.hpp"
 
 //Includes for libSDL:
 #include <SDL3/SDL.h>
@@ -19,10 +25,12 @@
 
 //...and for c++ standard library functions:
 #include <chrono>
+#include <cmath>
 #include <iostream>
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <string>
 
 #ifdef _WIN32
 extern "C" { uint32_t GetACP(); }
@@ -43,6 +51,65 @@ int main(int argc, char **argv) {
 	try {
 #endif
 
+	//------------  command line ------------
+
+	//'--record-ppu FILE' records the PPU state of every frame to FILE
+	// (play it back with 'ppu-bench --replay FILE'):
+	std::string record_ppu_path;
+	//'--capture-native' makes screenshots and continuous capture save the PPU's own
+	// 256x240 image instead of the (scaled-up) window contents:
+	bool capture_native = false;
+	//'--tick-rate HZ' sets how many fixed-length simulation ticks run per second of real time
+	// (independent of the display's refresh rate):
+	double tick_rate = 60.0;
+	//'--record-input FILE' records the player's input, tick by tick, to FILE when the game exits:
+	std::string record_input_path;
+	//'--replay FILE' plays back input recorded with '--record-input' (ignoring the keyboard),
+	// one tick per frame, then reports how long each frame's update and draw took and exits
+	// (use the same '--level' it was recorded on):
+	std::string replay_path;
+	//'--level FILE' plays the level compiled to FILE (in the data directory) by build_level:
+	std::string level_file = "level1.levl";
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--record-ppu" && argi + 1 < argc) {
+			record_ppu_path = argv[++argi];
+		} else if (arg == "--capture-native") {
+			capture_native = true;
+		} else if (arg == "--tick-rate" && argi + 1 < argc) {
+			tick_rate = std::stod(argv[++argi]);
+			if (!(tick_rate >= 1.0 && tick_rate <= 1000.0)) {
+				std::cerr << "Tick rate should be between 1 and 1000 Hz." << std::endl;
+				return 1;
+			}
+		} else if (arg == "--record-input" && argi + 1 < argc) {
+			record_input_path = argv[++argi];
+		} else if (arg == "--replay" && argi + 1 < argc) {
+			replay_path = argv[++argi];
+		} else if (arg == "--level" && argi + 1 < argc) {
+			level_file = argv[++argi];
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--record-ppu FILE] [--capture-native] [--tick-rate HZ] [--record-input FILE | --replay FILE] [--level FILE]" << std::endl;
+			return 1;
+		}
+	}
+	if (!record_input_path.empty() && !replay_path.empty()) {
+		std::cerr << "Can't record input while replaying it." << std::endl;
+		return 1;
+	}
+
+	std::unique_ptr< InputRecording > replay;
+	if (!replay_path.empty()) {
+		replay = std::make_unique< InputRecording >();
+		try {
+			read_input_recording(replay_path, replay.get());
+		} catch (std::exception const &e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		std::cout << "Replaying " << replay->header.ticks << " ticks from '" << replay_path << "'." << std::endl;
+	}
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
@@ -105,8 +172,19 @@ int main(int argc, char **argv) {
 	//------------ load assets --------------
 	call_load_functions();
 
+	//(loaders may have changed GL state directly -- see gl_state.hpp)
+	gl_state.invalidate();
+
 	//------------ create game mode + make current --------------
-	Mode::set_current(std::make_shared< PlayMode >());
+	std::shared_ptr< PlayMode > play = std::make_shared< PlayMode >(PlayData::load(level_file));
+	if (!record_ppu_path.empty()) play->start_recording(record_ppu_path);
+	if (!record_input_path.empty()) play->start_input_recording();
+	if (replay) play->start_replay(*replay);
+	Mode::set_current(play);
+
+	//PRINTSCREEN saves a screenshot; SHIFT+PRINTSCREEN starts / stops saving every frame:
+	// (reads go through pixel-buffer objects and PNGs are written on another thread, so neither hitches)
+	std::unique_ptr< FrameCapture > capture = std::make_unique< FrameCapture >();
 
 	//------------ main loop ------------
 
@@ -121,10 +199,20 @@ int main(int argc, char **argv) {
 		window_size = glm::uvec2(w, h);
 		SDL_GetWindowSizeInPixels(Mode::window, &w, &h);
 		drawable_size = glm::uvec2(w, h);
-		glViewport(0, 0, drawable_size.x, drawable_size.y);
+		gl_state.viewport(0, 0, drawable_size.x, drawable_size.y);
 	};
 	on_resize();
 
+	//simulation runs in fixed ticks; real time not yet simulated builds up in 'unsimulated':
+	double const tick = 1.0 / tick_rate;
+	double unsimulated = 0.0;
+	//if frames are taking a very long time to process, drop time rather than run
+	// ever more ticks per frame (avoiding the spiral of death):
+	constexpr uint32_t MaxTicksPerFrame = 8;
+
+	//when replaying, the time each frame's update and draw took:
+	FrameTimes replay_times;
+
 	//This will loop until the current mode is set to null:
 	while (Mode::current) {
 		//every pass through the game loop creates one frame of output
@@ -143,51 +231,103 @@ int main(int argc, char **argv) {
 				} else if (evt.type == SDL_EVENT_QUIT) {
 					Mode::set_current(nullptr);
 					break;
+				} else if (evt.type == SDL_EVENT_KEY_DOWN && evt.key.key == SDLK_PRINTSCREEN && (evt.key.mod & SDL_KMOD_SHIFT)) {
+					// --- continuous capture key ---
+					if (capture->continuous()) {
+						capture->stop_continuous();
+						std::cout << "Stopped capturing frames (" << capture->frames_queued() << " still being saved)." << std::endl;
+					} else {
+						std::cout << "Capturing every frame to 'capture-NNNNNN.png'." << std::endl;
+						capture->start_continuous("capture-");
+					}
 				} else if (evt.type == SDL_EVENT_KEY_DOWN && evt.key.key == SDLK_PRINTSCREEN) {
 					// --- screenshot key ---
 					std::string filename = "screenshot.png";
 					std::cout << "Saving screenshot to '" << filename << "'." << std::endl;
-					glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-					glReadBuffer(GL_FRONT);
-					int w,h;
-					SDL_GetWindowSizeInPixels(Mode::window, &w, &h);
-					std::vector< glm::u8vec4 > data(w*h);
-					glReadPixels(0,0,w,h, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-					for (auto &px : data) {
-						px.a = 0xff;
-					}
-					save_png(filename, glm::uvec2(w,h), data.data(), LowerLeftOrigin);
+					capture->screenshot(filename);
 				}
 			}
 			if (!Mode::current) break;
 		}
 
-		{ //(2) call the current mode's "update" function to deal with elapsed time:
+		auto frame_start = std::chrono::high_resolution_clock::now();
+
+		if (replay) { //(2, replaying) exactly one tick per frame, so every run does the same work:
+			// (at the display's rate rather than in real time -- this is for comparing builds)
+			if (play->replay_finished()) break;
+			Mode::current->update(replay->header.tick_elapsed);
+			if (!Mode::current) break;
+		} else { //(2) call the current mode's "update" function once per whole tick of elapsed time:
 			auto current_time = std::chrono::high_resolution_clock::now();
 			static auto previous_time = current_time;
-			float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
+			unsimulated += std::chrono::duration< double >(current_time - previous_time).count();
 			previous_time = current_time;
 
-			//if frames are taking a very long time to process,
-			//lag to avoid spiral of death:
-			elapsed = std::min(0.1f, elapsed);
-
-			Mode::current->update(elapsed);
+			uint32_t ticks = 0;
+			while (unsimulated >= tick && ticks < MaxTicksPerFrame) {
+				Mode::current->update(float(tick));
+				unsimulated -= tick;
+				ticks += 1;
+				if (!Mode::current) break;
+			}
 			if (!Mode::current) break;
+
+			//(hit the cap -- lag rather than catch up)
+			if (unsimulated >= tick) unsimulated = std::fmod(unsimulated, tick);
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
-			Mode::current->draw(drawable_size);
+			//(draw between the last tick and the next one, by the fraction of a tick left unsimulated)
+			Mode::current->draw(drawable_size, (replay ? 0.0f : float(unsimulated / tick)));
+		}
+
+		if (replay) {
+			replay_times.add(std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - frame_start).count());
+		}
+
+		//start reading back this frame if it is being captured:
+		if (capture_native) {
+			capture->after_draw(glm::uvec2(PPU466::ScreenWidth, PPU466::ScreenHeight), play->ppu.native_texture());
+		} else {
+			capture->after_draw(drawable_size);
 		}
 
 		//Wait until the recently-drawn frame is shown before doing it all again:
 		SDL_GL_SwapWindow(Mode::window);
+
+		//(start counting GL state changes for the next frame)
+		gl_state.end_frame();
 	}
 
 
+	//------------  report / save input ------------
+
+	if (replay) {
+		std::cout << "Replayed " << play->tick << " of " << replay->header.ticks << " ticks from '" << replay_path << "'";
+		if (play->replay_finished()) {
+			bool same = (play->state_hash() == replay->header.state_hash);
+			std::cout << "; final state " << (same ? "matches the recording." : "DIFFERS from the recording (simulation is not deterministic!)");
+		}
+		std::cout << "\nTime per frame (update + draw, before swap):\n";
+		replay_times.report(std::cout);
+		std::cout.flush();
+	}
+
+	if (!record_input_path.empty()) {
+		try {
+			play->save_input_recording(record_input_path);
+			std::cout << "Recorded input of " << play->tick << " ticks (" << play->input_recording->changes.size()
+				<< " changes) to '" << record_input_path << "'." << std::endl;
+		} catch (std::exception const &e) {
+			std::cerr << e.what() << std::endl;
+		}
+	}
+
 	//------------  teardown ------------
 
+	//(finishes saving any captured frames; needs the context)
+	capture.reset();
+
 	SDL_GL_DestroyContext(context);
 	context = 0;
 
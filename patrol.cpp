@@ -0,0 +1,164 @@
+#include "patrol.hpp"
+
+#include "cpu_features.hpp"
+#ifdef CPU_FEATURES_X86
+	#include <immintrin.h>
+#endif
+
+#include <cmath>
+
+void Patrols::clear() {
+	start_x.clear(); start_y.clear();
+	direction_x.clear(); direction_y.clear();
+	length.clear();
+	phase_rate.clear();
+	phase.clear();
+	x.clear(); y.clear();
+	active.clear();
+}
+
+uint32_t Patrols::add(glm::vec2 const &start, glm::vec2 const &direction, float length_) {
+	glm::vec2 dir = glm::vec2(0.0f);
+	float len = 0.0f;
+	if (glm::dot(direction, direction) > 0.0f && length_ > 0.0f) {
+		dir = glm::normalize(direction);
+		len = length_;
+	}
+
+	uint32_t index = uint32_t(size());
+	start_x.emplace_back(start.x); start_y.emplace_back(start.y);
+	direction_x.emplace_back(dir.x); direction_y.emplace_back(dir.y);
+	length.emplace_back(len);
+	phase_rate.emplace_back(len > 0.0f ? 0.5f / len : 0.0f);
+	phase.emplace_back(0.0f);
+	x.emplace_back(start.x); y.emplace_back(start.y);
+	active.emplace_back(1);
+	return index;
+}
+
+glm::vec2 Patrols::position_at(uint32_t i, float elapsed) const {
+	float at = phase[i] + speed * elapsed * phase_rate[i];
+	at = at - std::floor(at);
+	float along = length[i] * (1.0f - std::abs(1.0f - 2.0f * at));
+	return glm::vec2(start_x[i] + direction_x[i] * along, start_y[i] + direction_y[i] * along);
+}
+
+namespace {
+
+//Every kernel does the same float operations in the same order, so they agree exactly:
+//  phase += distance * phase_rate;  phase -= floor(phase);
+//  along = length * (1 - |1 - 2 * phase|);
+//  x = start_x + direction_x * along;  (and y)
+
+struct Arrays {
+	float const *start_x, *start_y, *direction_x, *direction_y, *length, *phase_rate;
+	float *phase, *x, *y;
+};
+
+//--------------------------------------------------------------
+//Scalar kernel (the reference the others are checked against):
+
+void step_scalar(Arrays const &a, size_t begin, size_t end, float distance) {
+	for (size_t i = begin; i < end; ++i) {
+		float phase = a.phase[i] + distance * a.phase_rate[i];
+		phase = phase - std::floor(phase);
+		float along = a.length[i] * (1.0f - std::abs(1.0f - 2.0f * phase));
+		a.phase[i] = phase;
+		a.x[i] = a.start_x[i] + a.direction_x[i] * along;
+		a.y[i] = a.start_y[i] + a.direction_y[i] * along;
+	}
+}
+
+#ifdef CPU_FEATURES_X86
+//--------------------------------------------------------------
+//SSE2 kernel (four patrols at a time):
+
+void step_sse2(Arrays const &a, size_t count, float distance) {
+	__m128 const dist = _mm_set1_ps(distance);
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const two = _mm_set1_ps(2.0f);
+	__m128 const abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 phase = _mm_add_ps(_mm_loadu_ps(a.phase + i), _mm_mul_ps(dist, _mm_loadu_ps(a.phase_rate + i)));
+		//(phase is never negative, so truncating is flooring -- and SSE2 has no floor)
+		phase = _mm_sub_ps(phase, _mm_cvtepi32_ps(_mm_cvttps_epi32(phase)));
+		__m128 along = _mm_mul_ps(_mm_loadu_ps(a.length + i), _mm_sub_ps(one, _mm_and_ps(abs_mask, _mm_sub_ps(one, _mm_mul_ps(two, phase)))));
+		_mm_storeu_ps(a.phase + i, phase);
+		_mm_storeu_ps(a.x + i, _mm_add_ps(_mm_loadu_ps(a.start_x + i), _mm_mul_ps(_mm_loadu_ps(a.direction_x + i), along)));
+		_mm_storeu_ps(a.y + i, _mm_add_ps(_mm_loadu_ps(a.start_y + i), _mm_mul_ps(_mm_loadu_ps(a.direction_y + i), along)));
+	}
+
+	step_scalar(a, i, count, distance);
+}
+
+//--------------------------------------------------------------
+//AVX2 kernel (eight patrols at a time):
+
+CPU_TARGET_AVX2
+void step_avx2(Arrays const &a, size_t count, float distance) {
+	__m256 const dist = _mm256_set1_ps(distance);
+	__m256 const one = _mm256_set1_ps(1.0f);
+	__m256 const two = _mm256_set1_ps(2.0f);
+	__m256 const abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 phase = _mm256_add_ps(_mm256_loadu_ps(a.phase + i), _mm256_mul_ps(dist, _mm256_loadu_ps(a.phase_rate + i)));
+		phase = _mm256_sub_ps(phase, _mm256_floor_ps(phase));
+		__m256 along = _mm256_mul_ps(_mm256_loadu_ps(a.length + i), _mm256_sub_ps(one, _mm256_and_ps(abs_mask, _mm256_sub_ps(one, _mm256_mul_ps(two, phase)))));
+		_mm256_storeu_ps(a.phase + i, phase);
+		_mm256_storeu_ps(a.x + i, _mm256_add_ps(_mm256_loadu_ps(a.start_x + i), _mm256_mul_ps(_mm256_loadu_ps(a.direction_x + i), along)));
+		_mm256_storeu_ps(a.y + i, _mm256_add_ps(_mm256_loadu_ps(a.start_y + i), _mm256_mul_ps(_mm256_loadu_ps(a.direction_y + i), along)));
+	}
+
+	step_scalar(a, i, count, distance);
+}
+#endif //CPU_FEATURES_X86
+
+//--------------------------------------------------------------
+//Dispatch:
+
+struct Kernel {
+	PatrolKernel kernel;
+	void (*step)(Arrays const &, size_t, float);
+};
+
+Kernel const ScalarKernel{ PatrolKernel::Scalar, [](Arrays const &a, size_t count, float distance){ step_scalar(a, 0, count, distance); } };
+#ifdef CPU_FEATURES_X86
+Kernel const SSE2Kernel{ PatrolKernel::SSE2, step_sse2 };
+Kernel const AVX2Kernel{ PatrolKernel::AVX2, step_avx2 };
+#endif
+
+SIMDDispatch< Kernel > &dispatch() {
+	//set up on first use (so it also works during static initialization):
+	#ifdef CPU_FEATURES_X86
+	static SIMDDispatch< Kernel > dispatch({ &ScalarKernel, &SSE2Kernel, &AVX2Kernel });
+	#else
+	static SIMDDispatch< Kernel > dispatch({ &ScalarKernel, nullptr, nullptr });
+	#endif
+	return dispatch;
+}
+
+} //namespace
+
+void Patrols::step(float elapsed) {
+	Arrays arrays{
+		start_x.data(), start_y.data(), direction_x.data(), direction_y.data(), length.data(), phase_rate.data(),
+		phase.data(), x.data(), y.data()
+	};
+	dispatch()->step(arrays, size(), speed * elapsed);
+}
+
+PatrolKernel patrol_kernel() {
+	return dispatch()->kernel;
+}
+
+char const *patrol_kernel_name(PatrolKernel kernel) {
+	return simd_kernel_name(kernel);
+}
+
+bool set_patrol_kernel(PatrolKernel kernel) {
+	return dispatch().set(kernel);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "cpu_features.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Patrols moves many entities back and forth along straight paths (PlayMode's enemies).
+ *
+ * State is kept as structure-of-arrays, one entry per patrol in each vector, so step()
+ * can update several patrols per instruction. Instead of a direction flag, each patrol
+ * keeps a phase in [0,1) around its whole out-and-back loop; its distance along the path is
+ * the triangle wave length * (1 - |1 - 2 * phase|), which needs no per-patrol branches.
+ *
+ * Like the bitplane functions, step() has scalar and (on x86-64) SSE2 and AVX2 versions,
+ * and uses the fastest one the CPU supports.
+ */
+struct Patrols {
+	float speed = 30.0f; //pixels per second, shared by every patrol
+
+	//per-patrol state:
+	std::vector< float > start_x, start_y; //start of the path
+	std::vector< float > direction_x, direction_y; //unit direction of the path (zero if stationary)
+	std::vector< float > length; //length of the path
+	std::vector< float > phase_rate; //1 / (2 * length): phase per pixel travelled (zero if stationary)
+	std::vector< float > phase; //fraction of the out-and-back loop done, in [0,1)
+	std::vector< float > x, y; //current position (written by step())
+	std::vector< uint8_t > active; //1 if the patrol is in play
+
+	size_t size() const { return x.size(); }
+	void clear();
+
+	//add a patrol starting at 'start' and heading 'length' pixels along 'direction' (needn't be normalized);
+	// a zero direction or length makes it stationary. Returns its index.
+	uint32_t add(glm::vec2 const &start, glm::vec2 const &direction, float length);
+
+	glm::vec2 position(uint32_t i) const { return glm::vec2(x[i], y[i]); }
+
+	//where patrol i will be 'elapsed' seconds after the last step() (negative for before it);
+	// e.g., for drawing between simulation ticks:
+	glm::vec2 position_at(uint32_t i, float elapsed) const;
+
+	//advance every patrol by 'elapsed' seconds (inactive ones too -- it is cheaper not to check):
+	void step(float elapsed);
+};
+
+//which implementation Patrols::step uses:
+// (picked and switched with SIMDDispatch; see cpu_features.hpp)
+using PatrolKernel = SIMDKernel;
+PatrolKernel patrol_kernel();
+char const *patrol_kernel_name(PatrolKernel kernel);
+
+//for benchmarks and self-checks -- switch to another implementation:
+// returns false (and changes nothing) if this CPU or build can't run 'kernel'
+bool set_patrol_kernel(PatrolKernel kernel);
@@ -0,0 +1,563 @@
+//ppu-bench runs the PPU466 through synthetic workloads and reports per-stage timings.
+//
+// usage:
+//   ppu-bench [--gl] [--dense] [--frames N] [--path strip|instanced|tilemap] [--record FILE] [workload ...]
+//   ppu-bench [--gl] [--dense] [--frames N] [--path strip|instanced|tilemap] --replay FILE
+//   ppu-bench --bitplanes
+//
+// workloads (default: all of them, one after the other):
+//   sprites  -- every sprite moves every frame
+//   scroll   -- background_position sweeps across the whole (wrapping) background
+//   palette  -- every palette is cycled every frame
+//   tiles    -- the whole tile table is rewritten every frame
+//   replay   -- frames from a recording (only with '--replay'; starts over when the recording runs out)
+//
+// By default frames are rendered with the software rasterizer (PPU466::render_to_buffer),
+// so no GPU or window is needed. With '--gl', frames go through PPU466::draw in an
+// OpenGL context attached to a hidden window, and a 'finish' stage (glFinish) is added
+// so the GPU's share of the work shows up somewhere. Every '--gl' frame is also read back
+// from native_texture() and compared, pixel by pixel, with render_to_buffer's image of the
+// same state; any mismatched pixels are reported and make ppu-bench fail.
+//
+// '--dense' runs the workloads on PPU466Dense (256 sprites, 1024 tiles) instead of PPU466.
+//
+// '--record FILE' also writes every frame's PPU state to FILE (see ppu_record.hpp), reports
+// the recording's size, and then plays it back to check that it reproduces every frame.
+// '--replay FILE' uses such a recording (e.g., one made by the game) as the workload.
+//
+// '--bitplanes' instead checks every bitplane kernel (see bitplanes.hpp) against the
+// scalar one on every possible row, then times decode / encode / mirror with each.
+
+#include "PPU466.hpp"
+#include "bitplanes.hpp"
+#include "ppu_record.hpp"
+
+//for the GL path:
+#include "Load.hpp"
+#include "GL.hpp"
+#include "gl_state.hpp"
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_main.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+template< typename PPUType >
+struct Workload {
+	std::string name;
+	std::function< void(PPUType &, uint32_t frame) > step; //modify the PPU before rendering 'frame'
+};
+
+//fill the PPU with arbitrary (but repeatable) content so every workload starts from the same place:
+template< typename PPUType >
+static void randomize(PPUType &ppu) {
+	std::mt19937 mt(0x466);
+	for (auto &palette : ppu.palette_table) {
+		palette[0] = glm::u8vec4(0x00, 0x00, 0x00, 0x00);
+		for (uint32_t i = 1; i < 4; ++i) {
+			palette[i] = glm::u8vec4(mt(), mt(), mt(), 0xff);
+		}
+	}
+	for (auto &tile : ppu.tile_table) {
+		for (uint32_t y = 0; y < 8; ++y) {
+			tile.bit0[y] = uint8_t(mt());
+			tile.bit1[y] = uint8_t(mt());
+		}
+	}
+	for (auto &info : ppu.background) {
+		info = uint16_t((mt() % PPUType::TileCount) | ((mt() % PPUType::PaletteCount) << PPUType::BackgroundPaletteShift));
+	}
+	for (auto &sprite : ppu.sprites) {
+		sprite.x = uint8_t(mt());
+		sprite.y = uint8_t(mt() % 240);
+		sprite.index = typename PPUType::TileIndex(mt() % PPUType::TileCount);
+		sprite.attributes = uint8_t((mt() % PPUType::PaletteCount) | (mt() % 2 ? 0x80 : 0x00));
+	}
+	ppu.background_position = glm::ivec2(0,0);
+}
+
+//hash of everything draw() reads (for checking that a replay reproduces its recording):
+template< typename PPUType >
+static uint64_t state_hash(PPUType const &ppu) {
+	uint64_t hash = 0xcbf29ce484222325ULL; //(64-bit FNV-1a)
+	auto add = [&hash](void const *data, size_t size) {
+		for (size_t i = 0; i < size; ++i) {
+			hash = (hash ^ reinterpret_cast< uint8_t const * >(data)[i]) * 0x100000001b3ULL;
+		}
+	};
+	add(&ppu.background_color, sizeof(ppu.background_color));
+	add(&ppu.background_position, sizeof(ppu.background_position));
+	add(ppu.palette_table.data(), sizeof(ppu.palette_table));
+	add(ppu.tile_table.data(), sizeof(ppu.tile_table));
+	add(ppu.background.data(), sizeof(ppu.background));
+	for (auto const &sprite : ppu.sprites) {
+		//(field by field, since PPU466Dense's Sprite has a padding byte)
+		add(&sprite.x, sizeof(sprite.x));
+		add(&sprite.y, sizeof(sprite.y));
+		add(&sprite.index, sizeof(sprite.index));
+		add(&sprite.attributes, sizeof(sprite.attributes));
+	}
+	return hash;
+}
+
+//(the 'replay' workload is only included when 'replay_path' is given)
+template< typename PPUType >
+static std::vector< Workload< PPUType > > make_workloads(std::string const &replay_path) {
+	std::vector< Workload< PPUType > > workloads;
+
+	workloads.push_back({"sprites", [](PPUType &ppu, uint32_t frame) {
+		for (uint32_t i = 0; i < ppu.sprites.size(); ++i) {
+			float t = 0.05f * float(frame) + 0.7f * float(i);
+			ppu.sprites[i].x = uint8_t(124.0f + 120.0f * std::cos(t));
+			ppu.sprites[i].y = uint8_t(116.0f + 110.0f * std::sin(1.3f * t));
+		}
+	}});
+
+	workloads.push_back({"scroll", [](PPUType &ppu, uint32_t frame) {
+		//(steps are coprime with the background size, so every offset eventually shows up)
+		ppu.background_position = glm::ivec2(int32_t(frame) * 7, -int32_t(frame) * 3);
+	}});
+
+	workloads.push_back({"palette", [](PPUType &ppu, uint32_t frame) {
+		//rotate colors 1-3 of every palette:
+		if (frame == 0) {
+			for (uint32_t p = 0; p < ppu.palette_table.size(); ++p) {
+				PPUBase::PaletteCycle cycle;
+				cycle.first = uint8_t(4 * p + 1);
+				cycle.count = 3;
+				ppu.palette_cycles.emplace_back(cycle);
+			}
+		}
+		ppu.animate_palettes();
+	}});
+
+	workloads.push_back({"tiles", [](PPUType &ppu, uint32_t frame) {
+		for (auto &tile : ppu.tile_table) {
+			for (uint32_t y = 0; y < 8; ++y) {
+				tile.bit0[y] = uint8_t(tile.bit0[y] + 1);
+				tile.bit1[y] ^= uint8_t(frame);
+			}
+		}
+	}});
+
+	if (!replay_path.empty()) {
+		struct Replay {
+			std::string recording; //the whole file, so playback doesn't wait on the disk
+			std::istringstream stream;
+			std::unique_ptr< PPUPlayer< PPUType > > player;
+		};
+		auto replay = std::make_shared< Replay >();
+		workloads.push_back({"replay", [replay_path,replay](PPUType &ppu, uint32_t frame) {
+			if (frame == 0) {
+				std::ifstream file(replay_path, std::ios::binary);
+				if (!file) throw std::runtime_error("Failed to open recording '" + replay_path + "'.");
+				replay->recording.assign(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >());
+				replay->player.reset();
+			}
+			if (!replay->player || !replay->player->play(&ppu)) {
+				//(re)start from the top -- the first frame is a keyframe, so this works from any state:
+				replay->stream = std::istringstream(replay->recording);
+				replay->player = std::make_unique< PPUPlayer< PPUType > >(&replay->stream);
+				if (!replay->player->play(&ppu)) throw std::runtime_error("Recording '" + replay_path + "' has no frames.");
+			}
+		}});
+	}
+
+	return workloads;
+}
+
+//check each SIMD bitplane kernel against the scalar one on all 2^16 possible rows, then time them:
+static int run_bitplanes() {
+	BitplaneKernel const default_kernel = bitplane_kernel();
+
+	//every possible (bit0, bit1) row pair, eight per tile:
+	std::vector< PPU466::Tile > all_rows(65536 / 8);
+	for (uint32_t r = 0; r < 65536; ++r) {
+		all_rows[r / 8].bit0[r % 8] = uint8_t(r);
+		all_rows[r / 8].bit1[r % 8] = uint8_t(r >> 8);
+	}
+
+	//every possible row of eight 2-bit indices, with junk in the unused upper bits:
+	// (stored with a row stride of 11 to catch kernels that assume packed rows)
+	constexpr size_t Stride = 11;
+	std::vector< uint8_t > all_indices(65536 * Stride);
+	for (uint32_t r = 0; r < 65536; ++r) {
+		for (uint32_t x = 0; x < 8; ++x) {
+			all_indices[r * Stride + x] = uint8_t(((r >> (2 * x)) & 3) | ((r * 0x9d + x * 0x35) & 0xfc));
+		}
+	}
+
+	struct Results {
+		std::vector< uint8_t > decoded; //decode_tiles() output
+		std::vector< uint8_t > decoded_strided; //decode_tile() into a Stride-wide image
+		std::vector< PPU466::Tile > encoded;
+		std::vector< PPU466::Tile > mirrored;
+	};
+	auto compute = [&]() {
+		Results res;
+		res.decoded.assign(all_rows.size() * 64, 0xee);
+		decode_tiles(all_rows.data(), all_rows.size(), res.decoded.data());
+
+		res.decoded_strided.assign(all_rows.size() * 8 * Stride, 0xee);
+		for (size_t t = 0; t < all_rows.size(); ++t) {
+			decode_tile(all_rows[t], res.decoded_strided.data() + t * 8 * Stride, Stride);
+		}
+
+		res.encoded.resize(65536 / 8);
+		for (size_t t = 0; t < res.encoded.size(); ++t) {
+			encode_tile(all_indices.data() + t * 8 * Stride, Stride, &res.encoded[t]);
+		}
+
+		//(an odd count, so kernels that work on pairs of tiles also run their tail code)
+		res.mirrored = all_rows;
+		mirror_tiles(res.mirrored.data(), res.mirrored.size() - 1);
+		return res;
+	};
+
+	std::vector< BitplaneKernel > kernels;
+	for (BitplaneKernel k : { BitplaneKernel::Scalar, BitplaneKernel::SSE2, BitplaneKernel::AVX2 }) {
+		if (set_bitplane_kernel(k)) kernels.emplace_back(k);
+	}
+
+	set_bitplane_kernel(BitplaneKernel::Scalar);
+	Results const reference = compute();
+
+	bool ok = true;
+	auto same_tiles = [](std::vector< PPU466::Tile > const &a, std::vector< PPU466::Tile > const &b) {
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(PPU466::Tile)) == 0;
+	};
+	for (BitplaneKernel k : kernels) {
+		if (k == BitplaneKernel::Scalar) continue;
+		set_bitplane_kernel(k);
+		Results const res = compute();
+		char const *name = bitplane_kernel_name(k);
+		if (res.decoded != reference.decoded) { std::cerr << name << ": decode_tiles differs from scalar.\n"; ok = false; }
+		if (res.decoded_strided != reference.decoded_strided) { std::cerr << name << ": decode_tile differs from scalar.\n"; ok = false; }
+		if (!same_tiles(res.encoded, reference.encoded)) { std::cerr << name << ": encode_tile differs from scalar.\n"; ok = false; }
+		if (!same_tiles(res.mirrored, reference.mirrored)) { std::cerr << name << ": mirror_tiles differs from scalar.\n"; ok = false; }
+	}
+
+	//the scalar kernel itself should round-trip, and mirroring twice should do nothing:
+	{
+		for (auto const &tile : reference.encoded) {
+			PPU466::Tile again;
+			std::vector< uint8_t > decoded(64);
+			set_bitplane_kernel(BitplaneKernel::Scalar);
+			decode_tile(tile, decoded.data(), 8);
+			encode_tile(decoded.data(), 8, &again);
+			if (std::memcmp(&again, &tile, sizeof(tile)) != 0) { std::cerr << "scalar: decode/encode does not round-trip.\n"; ok = false; break; }
+		}
+		std::vector< PPU466::Tile > twice = reference.mirrored;
+		mirror_tiles(twice.data(), twice.size() - 1);
+		if (!same_tiles(twice, all_rows)) { std::cerr << "scalar: mirroring twice is not the identity.\n"; ok = false; }
+	}
+
+	std::cout << "bitplanes: ";
+	for (BitplaneKernel k : kernels) std::cout << bitplane_kernel_name(k) << ' ';
+	std::cout << (ok ? "match on all 65536 rows" : "MISMATCH") << " (default: " << bitplane_kernel_name(default_kernel) << ")\n";
+
+	//timing -- a tile table's worth of tiles, many times over:
+	std::cout << "  " << std::left << std::setw(8) << "kernel" << std::right
+		<< std::setw(14) << "decode ns/t" << std::setw(14) << "encode ns/t" << std::setw(14) << "mirror ns/t" << '\n';
+	std::vector< PPU466::Tile > tiles(all_rows.begin(), all_rows.begin() + 256);
+	std::vector< uint8_t > out(256 * 64);
+	constexpr uint32_t Reps = 2000;
+	for (BitplaneKernel k : kernels) {
+		set_bitplane_kernel(k);
+		auto time_ns_per_tile = [&](auto &&fn) {
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint32_t rep = 0; rep < Reps; ++rep) fn();
+			auto after = std::chrono::high_resolution_clock::now();
+			return std::chrono::duration< double, std::nano >(after - before).count() / double(Reps * tiles.size());
+		};
+		double decode_ns = time_ns_per_tile([&](){ decode_tiles(tiles.data(), tiles.size(), out.data()); });
+		double encode_ns = time_ns_per_tile([&](){
+			for (size_t t = 0; t < tiles.size(); ++t) encode_tile(out.data() + 64 * t, 8, &tiles[t]);
+		});
+		double mirror_ns = time_ns_per_tile([&](){ mirror_tiles(tiles.data(), tiles.size()); });
+		std::cout << "  " << std::left << std::setw(8) << bitplane_kernel_name(k) << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(14) << decode_ns << std::setw(14) << encode_ns << std::setw(14) << mirror_ns << '\n';
+	}
+
+	set_bitplane_kernel(default_kernel);
+	return ok ? 0 : 1;
+}
+
+//render 'frames' frames of each selected workload (all workloads if none are selected) and report timings:
+// (if 'record_path' is given, also record every frame there and check the recording plays back; with 'use_gl', also check
+//  every frame against render_to_buffer; returns false if either check fails)
+template< typename PPUType >
+static bool run_workloads(std::vector< std::string > const &selected, uint32_t frames, PPUBase::DrawPath path, bool use_gl, std::string const &record_path, std::string const &replay_path) {
+	struct Stage {
+		char const *name;
+		std::vector< float > ms; //one entry per frame
+	};
+
+	static std::array< glm::u8vec4, PPUType::ScreenWidth * PPUType::ScreenHeight > pixels;
+	static std::array< glm::u8vec4, PPUType::ScreenWidth * PPUType::ScreenHeight > read_back; //(--gl: native_texture's contents)
+	GLuint read_back_fb = 0; //(--gl: framebuffer with native_texture attached, made after the first draw)
+	bool ok = true;
+
+	std::ofstream record_file;
+	std::unique_ptr< PPURecorder< PPUType > > recorder;
+	std::vector< uint64_t > recorded_hashes; //state_hash of each recorded frame
+	if (!record_path.empty()) {
+		record_file.open(record_path, std::ios::binary);
+		if (!record_file) {
+			std::cerr << "Failed to open '" << record_path << "' for writing." << std::endl;
+			return false;
+		}
+		recorder = std::make_unique< PPURecorder< PPUType > >(&record_file);
+	}
+
+	for (auto const &workload : make_workloads< PPUType >(replay_path)) {
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), workload.name) == selected.end()) continue;
+
+		PPUType ppu;
+		randomize(ppu);
+		ppu.draw_path = path;
+
+		std::vector< Stage > stages{
+			{"build", {}}, {"decode", {}}, {"upload", {}}, {"submit", {}}, {"raster", {}}, {"finish", {}}, {"total", {}}
+		};
+
+		uint32_t fence_waits = 0; //times draw() waited on the GPU to reuse a stream region
+		uint64_t state_changes = 0; //GL state changes made by draw()
+		uint64_t state_skipped = 0; //redundant GL state changes draw() skipped
+		uint64_t mismatched = 0; //pixels where draw() and render_to_buffer disagree
+
+		//render one frame before timing so first-use costs (e.g., full texture uploads) aren't counted:
+		for (uint32_t frame = 0; frame <= frames; ++frame) {
+			workload.step(ppu, frame);
+
+			if (recorder) {
+				recorder->record(ppu);
+				recorded_hashes.emplace_back(state_hash(ppu));
+			}
+
+			PPUBase::DrawStats stats;
+			float finish_ms = 0.0f;
+			auto before = std::chrono::high_resolution_clock::now();
+			if (use_gl) {
+				ppu.draw(glm::uvec2(PPUType::ScreenWidth, PPUType::ScreenHeight), &stats);
+				auto before_finish = std::chrono::high_resolution_clock::now();
+				glFinish();
+				gl_state.end_frame();
+				finish_ms = std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - before_finish).count();
+			} else {
+				ppu.render_to_buffer(&pixels, &stats);
+			}
+			float total_ms = std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - before).count();
+
+			//(outside the timed part) check the GPU's frame against the software rasterizer's:
+			if (use_gl) {
+				if (read_back_fb == 0) {
+					glGenFramebuffers(1, &read_back_fb);
+					gl_state.bind_framebuffer(GL_READ_FRAMEBUFFER, read_back_fb);
+					glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ppu.native_texture(), 0);
+				}
+				gl_state.bind_framebuffer(GL_READ_FRAMEBUFFER, read_back_fb);
+				glReadPixels(0, 0, PPUType::ScreenWidth, PPUType::ScreenHeight, GL_RGBA, GL_UNSIGNED_BYTE, read_back.data());
+				gl_state.bind_framebuffer(GL_READ_FRAMEBUFFER, 0);
+
+				ppu.render_to_buffer(&pixels);
+				for (size_t i = 0; i < pixels.size(); ++i) {
+					if (pixels[i] != read_back[i]) mismatched += 1;
+				}
+			}
+
+			if (frame == 0) continue;
+			fence_waits += stats.fence_waits;
+			state_changes += stats.gl_state_changes;
+			state_skipped += stats.gl_state_skipped;
+			stages[0].ms.emplace_back(stats.build_ms);
+			stages[1].ms.emplace_back(stats.decode_ms);
+			stages[2].ms.emplace_back(stats.upload_ms);
+			stages[3].ms.emplace_back(stats.submit_ms);
+			stages[4].ms.emplace_back(stats.raster_ms);
+			stages[5].ms.emplace_back(finish_ms);
+			stages[6].ms.emplace_back(total_ms);
+		}
+
+		std::cout << "\nworkload '" << workload.name << "':\n";
+		std::cout << "  " << std::left << std::setw(8) << "stage" << std::right
+			<< std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << '\n';
+		for (auto &stage : stages) {
+			std::sort(stage.ms.begin(), stage.ms.end());
+			if (stage.ms.back() == 0.0f) continue; //stage not used by this renderer
+			auto percentile = [&stage](float p) {
+				return stage.ms[std::min(stage.ms.size() - 1, size_t(p * float(stage.ms.size())))];
+			};
+			std::cout << "  " << std::left << std::setw(8) << stage.name << std::right << std::fixed << std::setprecision(4)
+				<< std::setw(10) << percentile(0.50f)
+				<< std::setw(10) << percentile(0.90f)
+				<< std::setw(10) << percentile(0.99f)
+				<< std::setw(10) << stage.ms.back() << '\n';
+		}
+		if (use_gl) {
+			std::cout << "  fence waits: " << fence_waits << " in " << frames << " frames\n";
+			std::cout << "  GL state changes per frame: " << std::setprecision(1) << double(state_changes) / frames
+				<< " made, " << double(state_skipped) / frames << " skipped\n";
+			std::cout << "  GL vs. software: " << mismatched << " mismatched pixels in " << frames + 1 << " frames\n";
+			if (mismatched != 0) ok = false;
+		}
+		std::cout.flush();
+	}
+
+	if (read_back_fb != 0) glDeleteFramebuffers(1, &read_back_fb);
+
+	if (recorder) {
+		record_file.close();
+		std::cout << "\nrecorded " << recorder->frames << " frames to '" << record_path << "': " << recorder->bytes << " bytes ("
+			<< std::setprecision(1) << double(recorder->bytes) / recorder->frames << " bytes per frame, "
+			<< double(recorder->bytes) / recorder->frames * 60.0 / 1024.0 << " KiB/s at 60 frames/s)" << std::endl;
+
+		//play the recording back and check it reproduces every frame:
+		std::ifstream file(record_path, std::ios::binary);
+		PPUPlayer< PPUType > player(&file);
+		PPUType replayed;
+		for (uint32_t frame = 0; frame < recorded_hashes.size(); ++frame) {
+			if (!player.play(&replayed) || state_hash(replayed) != recorded_hashes[frame]) {
+				std::cout << "playback of '" << record_path << "' differs from the recording at frame " << frame << "." << std::endl;
+				return false;
+			}
+		}
+		if (player.play(&replayed)) {
+			std::cout << "playback of '" << record_path << "' has more frames than were recorded." << std::endl;
+			return false;
+		}
+		std::cout << "playback reproduces all " << recorded_hashes.size() << " recorded frames." << std::endl;
+	}
+
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	//------------ command line ------------
+
+	bool use_gl = false;
+	bool dense = false;
+	uint32_t frames = 1000;
+	PPU466::DrawPath path = PPU466::DrawPath::Tilemap;
+	std::vector< std::string > selected;
+	std::string record_path;
+	std::string replay_path;
+
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--bitplanes") {
+			return run_bitplanes();
+		} else if (arg == "--gl") {
+			use_gl = true;
+		} else if (arg == "--dense") {
+			dense = true;
+		} else if (arg == "--record" && argi + 1 < argc) {
+			record_path = argv[++argi];
+		} else if (arg == "--replay" && argi + 1 < argc) {
+			replay_path = argv[++argi];
+		} else if (arg == "--frames" && argi + 1 < argc) {
+			frames = uint32_t(std::max(1, std::stoi(argv[++argi])));
+		} else if (arg == "--path" && argi + 1 < argc) {
+			std::string name = argv[++argi];
+			if (name == "strip") path = PPU466::DrawPath::TriangleStrip;
+			else if (name == "instanced") path = PPU466::DrawPath::Instanced;
+			else if (name == "tilemap") path = PPU466::DrawPath::Tilemap;
+			else {
+				std::cerr << "Unknown draw path '" << name << "'." << std::endl;
+				return 1;
+			}
+		} else if (arg.size() > 0 && arg[0] != '-') {
+			selected.emplace_back(arg);
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--gl] [--dense] [--frames N] [--path strip|instanced|tilemap] [--record FILE] [workload ...]\n\t"
+				<< argv[0] << " [--gl] [--dense] [--frames N] [--path strip|instanced|tilemap] --replay FILE\n\t"
+				<< argv[0] << " --bitplanes" << std::endl;
+			return 1;
+		}
+	}
+
+	//with a recording to replay, replay it (and nothing else):
+	if (!replay_path.empty()) selected = { "replay" };
+
+	{ //check workload names before doing any work:
+		std::vector< Workload< PPU466 > > workloads = make_workloads< PPU466 >(replay_path);
+		for (auto const &name : selected) {
+			auto f = std::find_if(workloads.begin(), workloads.end(), [&](Workload< PPU466 > const &w){ return w.name == name; });
+			if (f == workloads.end()) {
+				std::cerr << "Unknown workload '" << name << "'." << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	//------------ (optional) hidden-window GL context ------------
+
+	SDL_Window *window = nullptr;
+	SDL_GLContext context = 0;
+	if (use_gl) {
+		SDL_Init(SDL_INIT_VIDEO);
+
+		SDL_GL_ResetAttributes();
+		SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+
+		window = SDL_CreateWindow("ppu-bench", PPU466::ScreenWidth, PPU466::ScreenHeight, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+		if (!window) {
+			std::cerr << "Error creating SDL window: " << SDL_GetError() << std::endl;
+			return 1;
+		}
+		context = SDL_GL_CreateContext(window);
+		if (!context) {
+			SDL_DestroyWindow(window);
+			std::cerr << "Error creating OpenGL context: " << SDL_GetError() << std::endl;
+			return 1;
+		}
+
+		init_GL();
+		call_load_functions();
+
+		//(loaders may have changed GL state directly -- see gl_state.hpp)
+		gl_state.invalidate();
+	}
+
+	//------------ run workloads ------------
+
+	std::cout << "ppu-bench: " << frames << " frames per workload, "
+		<< (use_gl ? "OpenGL (hidden window)" : "software rasterizer")
+		<< (dense ? ", dense PPU" : "") << std::endl;
+
+	bool ok = false;
+	try {
+		if (dense) ok = run_workloads< PPU466Dense >(selected, frames, path, use_gl, record_path, replay_path);
+		else ok = run_workloads< PPU466 >(selected, frames, path, use_gl, record_path, replay_path);
+	} catch (std::exception const &e) {
+		//(e.g., a recording that can't be read)
+		std::cerr << e.what() << std::endl;
+	}
+
+	//------------ teardown ------------
+
+	if (use_gl) {
+		SDL_GL_DestroyContext(context);
+		SDL_DestroyWindow(window);
+	}
+
+	return ok ? 0 : 1;
+}
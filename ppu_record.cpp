@@ -0,0 +1,217 @@
+#include "ppu_record.hpp"
+#include "read_write_chunk.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+template< typename PPUType >
+PPURecordingHeader header_for() {
+	PPURecordingHeader header;
+	header.sprite_count = PPUType::SpriteCount;
+	header.tile_count = PPUType::TileCount;
+	header.palette_count = PPUType::PaletteCount;
+	header.background_width = PPUType::BackgroundWidth;
+	header.background_height = PPUType::BackgroundHeight;
+	return header;
+}
+
+//append the bytes of 'value' to 'out':
+template< typename T >
+void put(T const &value, std::vector< uint8_t > *out) {
+	uint8_t const *bytes = reinterpret_cast< uint8_t const * >(&value);
+	out->insert(out->end(), bytes, bytes + sizeof(T));
+}
+
+//append the runs of elements of 'now' that differ from 'before' (or one run covering all of 'now' if 'before' is null):
+// returns false (and appends nothing) if no element changed
+template< typename T, size_t N >
+bool put_runs(std::array< T, N > const &now, std::array< T, N > const *before, std::vector< uint8_t > *out_) {
+	static_assert(N <= 0xffff, "element indices and counts fit in 16 bits");
+	assert(out_);
+	auto &out = *out_;
+
+	//(compared with ==, field by field: element types may have padding, e.g., PPU466Dense's Sprite)
+	auto changed = [&](size_t i) {
+		return !before || !(now[i] == (*before)[i]);
+	};
+
+	//a gap of unchanged elements no bigger than a run header is cheaper to store than to skip:
+	constexpr size_t MaxGap = (2 * sizeof(uint16_t)) / sizeof(T);
+
+	size_t const runs_at = out.size();
+	uint16_t runs = 0;
+	put(runs, &out); //(filled in at the end)
+
+	for (size_t i = 0; i < N; ) {
+		if (!changed(i)) {
+			++i;
+			continue;
+		}
+		//extend the run past any short gaps:
+		size_t end = i + 1;
+		for (size_t j = end; j < N && j <= end + MaxGap; ++j) {
+			if (changed(j)) end = j + 1;
+		}
+
+		put(uint16_t(i), &out);
+		put(uint16_t(end - i), &out);
+		uint8_t const *bytes = reinterpret_cast< uint8_t const * >(&now[i]);
+		out.insert(out.end(), bytes, bytes + (end - i) * sizeof(T));
+
+		runs += 1;
+		i = end;
+	}
+
+	if (runs == 0) {
+		out.resize(runs_at);
+		return false;
+	}
+	std::memcpy(&out[runs_at], &runs, sizeof(runs));
+	return true;
+}
+
+//reads values from a frame's payload, throwing if it runs out:
+struct PayloadReader {
+	std::vector< uint8_t > const &payload;
+	size_t at = 0;
+
+	void get(void *to, size_t size) {
+		if (payload.size() - at < size) {
+			throw std::runtime_error("PPU recording frame is truncated.");
+		}
+		std::memcpy(to, payload.data() + at, size);
+		at += size;
+	}
+
+	template< typename T >
+	T get() {
+		T value;
+		get(&value, sizeof(T));
+		return value;
+	}
+
+	//read runs (as written by put_runs) into 'to', calling 'on_run(first, count)' for each:
+	template< typename T, size_t N, typename OnRun >
+	void get_runs(std::array< T, N > *to, OnRun &&on_run) {
+		uint16_t runs = get< uint16_t >();
+		for (uint32_t r = 0; r < runs; ++r) {
+			uint16_t first = get< uint16_t >();
+			uint16_t count = get< uint16_t >();
+			if (size_t(first) + count > N) {
+				throw std::runtime_error("PPU recording frame has a run outside its table.");
+			}
+			get(&(*to)[first], count * sizeof(T));
+			if (count) on_run(first, count);
+		}
+	}
+	template< typename T, size_t N >
+	void get_runs(std::array< T, N > *to) {
+		get_runs(to, [](uint32_t, uint32_t){});
+	}
+};
+
+}
+
+template< typename PPUType >
+PPURecorder< PPUType >::PPURecorder(std::ostream *to_) : to(*to_) {
+	std::vector< PPURecordingHeader > header{ header_for< PPUType >() };
+	write_chunk("PPUR", header, &to);
+	bytes += 8 + sizeof(PPURecordingHeader);
+}
+
+template< typename PPUType >
+void PPURecorder< PPUType >::record(PPUType const &ppu) {
+	PPUType const *before = previous.get();
+
+	payload.clear();
+	payload.emplace_back(0); //flags (filled in below)
+	uint8_t flags = (before ? 0 : PPUFrameFlags::Keyframe);
+
+	if (!before || ppu.background_color != before->background_color) {
+		flags |= PPUFrameFlags::BackgroundColor;
+		put(ppu.background_color, &payload);
+	}
+	if (!before || ppu.background_position != before->background_position) {
+		flags |= PPUFrameFlags::BackgroundPosition;
+		put(ppu.background_position, &payload);
+	}
+	if (put_runs(ppu.palette_table, before ? &before->palette_table : nullptr, &payload)) {
+		flags |= PPUFrameFlags::Palettes;
+	}
+	if (put_runs(ppu.tile_table, before ? &before->tile_table : nullptr, &payload)) {
+		flags |= PPUFrameFlags::Tiles;
+	}
+	if (put_runs(ppu.background, before ? &before->background : nullptr, &payload)) {
+		flags |= PPUFrameFlags::Background;
+	}
+	if (put_runs(ppu.sprites, before ? &before->sprites : nullptr, &payload)) {
+		flags |= PPUFrameFlags::Sprites;
+	}
+	payload[0] = flags;
+
+	write_chunk("PPUF", payload, &to);
+	bytes += 8 + payload.size();
+	frames += 1;
+
+	//remember what was recorded (just the parts draw() reads):
+	if (!previous) previous = std::make_unique< PPUType >();
+	previous->background_color = ppu.background_color;
+	previous->background_position = ppu.background_position;
+	previous->palette_table = ppu.palette_table;
+	previous->tile_table = ppu.tile_table;
+	previous->background = ppu.background;
+	previous->sprites = ppu.sprites;
+}
+
+template< typename PPUType >
+PPUPlayer< PPUType >::PPUPlayer(std::istream *from_) : from(*from_) {
+	std::vector< PPURecordingHeader > header;
+	read_chunk(from, "PPUR", &header);
+	PPURecordingHeader const expected = header_for< PPUType >();
+	if (header.size() != 1 || std::memcmp(&header[0], &expected, sizeof(expected)) != 0) {
+		throw std::runtime_error("PPU recording was made with a different PPU configuration.");
+	}
+}
+
+template< typename PPUType >
+bool PPUPlayer< PPUType >::play(PPUType *ppu) {
+	assert(ppu);
+	if (from.peek() == std::char_traits< char >::eof()) return false;
+
+	read_chunk(from, "PPUF", &payload);
+	PayloadReader reader{payload};
+
+	uint8_t flags = reader.get< uint8_t >();
+	if (frames == 0 && !(flags & PPUFrameFlags::Keyframe)) {
+		throw std::runtime_error("PPU recording doesn't start with a keyframe.");
+	}
+
+	if (flags & PPUFrameFlags::BackgroundColor) ppu->background_color = reader.get< glm::u8vec3 >();
+	if (flags & PPUFrameFlags::BackgroundPosition) ppu->background_position = reader.get< glm::ivec2 >();
+	if (flags & PPUFrameFlags::Palettes) reader.get_runs(&ppu->palette_table);
+	if (flags & PPUFrameFlags::Tiles) reader.get_runs(&ppu->tile_table);
+	if (flags & PPUFrameFlags::Background) {
+		//(marking the rows written in the background change hint -- see PPU466.hpp)
+		reader.get_runs(&ppu->background, [ppu](uint32_t first, uint32_t count) {
+			for (uint32_t y = first / PPUType::BackgroundWidth; y <= (first + count - 1) / PPUType::BackgroundWidth; ++y) {
+				ppu->background_rows_changed |= uint64_t(1) << y;
+			}
+		});
+	}
+	if (flags & PPUFrameFlags::Sprites) reader.get_runs(&ppu->sprites);
+
+	if (reader.at != payload.size()) {
+		throw std::runtime_error("PPU recording frame has trailing data.");
+	}
+
+	frames += 1;
+	return true;
+}
+
+template struct PPURecorder< PPU466 >;
+template struct PPURecorder< PPU466Dense >;
+template struct PPUPlayer< PPU466 >;
+template struct PPUPlayer< PPU466Dense >;
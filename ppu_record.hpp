@@ -0,0 +1,95 @@
+#pragma once
+
+#include "PPU466.hpp"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Recording and playback of PPU state, one frame at a time.
+ *
+ * A recording is a sequence of chunks (in the format read_write_chunk.hpp uses):
+ *  'PPUR' -- one PPURecordingHeader, giving the PPU configuration that was recorded
+ *  'PPUF' -- one per frame, holding the parts of the PPU state that changed since the previous frame
+ *
+ * Frame chunks are byte arrays (multi-byte values are native-endian, like the chunk headers):
+ *  uint8_t flags -- which of the sections below follow (see PPUFrameFlags), in this order:
+ *   BackgroundColor: u8vec3
+ *   BackgroundPosition: ivec2
+ *   Palettes, Tiles, Background, Sprites: changed runs of the corresponding table:
+ *     uint16_t run count, then for each run:
+ *     uint16_t first element, uint16_t element count, element bytes
+ *
+ * The first frame is a keyframe that stores everything, so playback doesn't depend on
+ * the starting state of the PPU it is played into. After that, a frame in which nothing
+ * changed costs nine bytes (chunk header + flags).
+ *
+ * Only what draw() reads is recorded: palette animations are captured by their effect on
+ * palette_table, and draw_path is left to the player.
+ */
+
+//the configuration a recording was made with:
+struct PPURecordingHeader {
+	uint32_t sprite_count = 0;
+	uint32_t tile_count = 0;
+	uint32_t palette_count = 0;
+	uint32_t background_width = 0;
+	uint32_t background_height = 0;
+};
+static_assert(sizeof(PPURecordingHeader) == 20, "PPURecordingHeader is packed");
+
+//bits of a frame's flags byte:
+struct PPUFrameFlags {
+	enum : uint8_t {
+		Keyframe = 0x01, //every section is present and covers its whole table
+		BackgroundColor = 0x02,
+		BackgroundPosition = 0x04,
+		Palettes = 0x08,
+		Tiles = 0x10,
+		Background = 0x20,
+		Sprites = 0x40,
+	};
+};
+
+template< typename PPUType >
+struct PPURecorder {
+	//writes the recording header to 'to', which must outlive the recorder:
+	PPURecorder(std::ostream *to);
+
+	//append the state of 'ppu' as the next frame:
+	void record(PPUType const &ppu);
+
+	uint32_t frames = 0; //frames recorded so far
+	uint64_t bytes = 0; //bytes written so far (including the header)
+
+private:
+	std::ostream &to;
+	std::unique_ptr< PPUType > previous; //state as of the last recorded frame (null before the first frame)
+	std::vector< uint8_t > payload; //frame being written (kept to reuse its allocation)
+};
+
+template< typename PPUType >
+struct PPUPlayer {
+	//reads the recording header from 'from', which must outlive the player:
+	// (throws if the recording was made with a different PPU configuration)
+	PPUPlayer(std::istream *from);
+
+	//apply the next frame of the recording to 'ppu':
+	// returns false (leaving 'ppu' alone) once the recording has run out.
+	// Frames after the first only hold changes, so pass the same PPU every time.
+	bool play(PPUType *ppu);
+
+	uint32_t frames = 0; //frames played so far
+
+private:
+	std::istream &from;
+	std::vector< uint8_t > payload; //frame being read (kept to reuse its allocation)
+};
+
+//(PPU466 and PPU466Dense recorders and players are compiled in ppu_record.cpp)
+extern template struct PPURecorder< PPU466 >;
+extern template struct PPURecorder< PPU466Dense >;
+extern template struct PPUPlayer< PPU466 >;
+extern template struct PPUPlayer< PPU466Dense >;
@@ -0,0 +1,52 @@
+#include "spatial_grid.hpp"
+
+#include <cassert>
+#include <cmath>
+
+SpatialGrid::SpatialGrid(glm::vec2 const &origin_, glm::vec2 const &size, float cell_size)
+	: origin(origin_), inv_cell_size(1.0f / cell_size) {
+	assert(cell_size > 0.0f && size.x > 0.0f && size.y > 0.0f);
+	cells = glm::ivec2(
+		std::max(1, int32_t(std::ceil(size.x / cell_size))),
+		std::max(1, int32_t(std::ceil(size.y / cell_size)))
+	);
+	cell_start.assign(size_t(cells.x) * size_t(cells.y) + 1, 0);
+}
+
+void SpatialGrid::clear() {
+	pending.clear();
+	pending_cells.clear();
+}
+
+void SpatialGrid::set_origin(glm::vec2 const &origin_) {
+	assert(pending.empty());
+	origin = origin_;
+}
+
+void SpatialGrid::insert(uint32_t id, glm::vec2 const &position) {
+	glm::ivec2 cell = cell_of(position);
+	pending.emplace_back(Entry{id, position});
+	pending_cells.emplace_back(uint32_t(cell.x + cells.x * cell.y));
+}
+
+void SpatialGrid::build() {
+	//counting sort by cell -- count each cell's entries:
+	std::fill(cell_start.begin(), cell_start.end(), 0);
+	for (uint32_t cell : pending_cells) {
+		cell_start[cell + 1] += 1;
+	}
+	//...turn counts into starting offsets:
+	for (size_t c = 1; c < cell_start.size(); ++c) {
+		cell_start[c] += cell_start[c - 1];
+	}
+	//...and place entries (using cell_start[c] as cell c's write position, which leaves it at the cell's end):
+	entries.resize(pending.size());
+	for (size_t i = 0; i < pending.size(); ++i) {
+		entries[cell_start[pending_cells[i]]++] = pending[i];
+	}
+	//...so shift everything back by one cell to get the starts again:
+	for (size_t c = cell_start.size() - 1; c > 0; --c) {
+		cell_start[c] = cell_start[c - 1];
+	}
+	cell_start[0] = 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+
+//SpatialGrid buckets points (e.g., entity positions) into square cells so that
+// radius and box queries only look at points in nearby cells.
+//
+//Use it once per tick: clear(), insert() every entity, build(), then query.
+// Points outside the grid's area are kept in the nearest edge cell, so queries
+// are still exact anywhere -- they just get slower if many points are far outside.
+struct SpatialGrid {
+	//covers [origin, origin + size) with cells 'cell_size' wide:
+	SpatialGrid(glm::vec2 const &origin, glm::vec2 const &size, float cell_size);
+
+	void clear();
+	//move the area the grid covers (e.g., to follow the camera around a large world); call between clear() and insert():
+	void set_origin(glm::vec2 const &origin);
+	void insert(uint32_t id, glm::vec2 const &position);
+	void build(); //sort inserted points into cells; call before querying
+
+	//call 'fn(id, position)' for every point within 'radius' of 'center' (distance <= radius);
+	// 'fn' returns true to stop early. Points are visited cell by cell, not in insertion order.
+	template< typename Fn >
+	void for_each_within(glm::vec2 const &center, float radius, Fn &&fn) const {
+		float const radius2 = radius * radius;
+		for_each_in_box(center - glm::vec2(radius), center + glm::vec2(radius), [&](uint32_t id, glm::vec2 const &position){
+			glm::vec2 d = position - center;
+			if (glm::dot(d, d) > radius2) return false;
+			return fn(id, position);
+		});
+	}
+
+	//call 'fn(id, position)' for every point in the box [min, max] (inclusive);
+	// 'fn' returns true to stop early.
+	template< typename Fn >
+	void for_each_in_box(glm::vec2 const &min, glm::vec2 const &max, Fn &&fn) const {
+		glm::ivec2 lo = cell_of(min);
+		glm::ivec2 hi = cell_of(max);
+		for (int32_t y = lo.y; y <= hi.y; ++y) {
+			for (int32_t x = lo.x; x <= hi.x; ++x) {
+				uint32_t cell = uint32_t(x + cells.x * y);
+				for (uint32_t i = cell_start[cell]; i < cell_start[cell + 1]; ++i) {
+					Entry const &entry = entries[i];
+					if (entry.position.x < min.x || entry.position.x > max.x) continue;
+					if (entry.position.y < min.y || entry.position.y > max.y) continue;
+					if (fn(entry.id, entry.position)) return;
+				}
+			}
+		}
+	}
+
+	size_t size() const { return pending.size(); }
+
+private:
+	glm::vec2 origin;
+	float inv_cell_size;
+	glm::ivec2 cells; //number of cells in each direction
+
+	struct Entry {
+		uint32_t id;
+		glm::vec2 position;
+	};
+	std::vector< Entry > pending; //inserted since clear()
+	std::vector< uint32_t > pending_cells; //cell of each pending entry
+	std::vector< Entry > entries; //pending entries sorted by cell (after build())
+	std::vector< uint32_t > cell_start; //entries of cell c are [cell_start[c], cell_start[c+1])
+
+	//cell containing 'position' (clamped to the grid):
+	glm::ivec2 cell_of(glm::vec2 const &position) const {
+		glm::vec2 at = (position - origin) * inv_cell_size;
+		//(clamp as floats first, so far-away points can't overflow the int conversion)
+		return glm::ivec2(
+			std::clamp(at.x, 0.0f, float(cells.x - 1)),
+			std::clamp(at.y, 0.0f, float(cells.y - 1))
+		);
+	}
+};
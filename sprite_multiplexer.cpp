@@ -0,0 +1,76 @@
+#include "sprite_multiplexer.hpp"
+
+#include <algorithm>
+
+void SpriteMultiplexer::clear() {
+	requests.clear();
+}
+
+void SpriteMultiplexer::add(Sprite const *sprite, int32_t x, int32_t y, uint32_t frame, bool flip_x, int32_t priority) {
+	if (!sprite || sprite->tiles.empty()) return;
+	requests.emplace_back(Request{sprite, x, y, frame, flip_x, priority});
+}
+
+uint32_t SpriteMultiplexer::pack(PPU466 *ppu_) {
+	PPU466 &ppu = *ppu_;
+	uint32_t const SlotCount = uint32_t(ppu.sprites.size());
+
+	//highest priority first (and otherwise in the order added):
+	order.resize(requests.size());
+	for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+	//(std::sort with the index as tie-breaker rather than std::stable_sort, which allocates a buffer every call)
+	std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b){
+		if (requests[a].priority != requests[b].priority) return requests[a].priority > requests[b].priority;
+		return a < b;
+	});
+
+	requested = uint32_t(requests.size());
+	dropped = 0;
+	slots_used = 0;
+
+	auto place = [&](Request const &request) {
+		uint32_t count = request.sprite->get_sprite_count();
+		if (slots_used + count > SlotCount) return false;
+		request.sprite->draw_frame(ppu, request.x, request.y, slots_used, request.frame, request.flip_x);
+		slots_used += count;
+		return true;
+	};
+
+	bool crowded = false; //(only the first level that doesn't fit takes turns; later ones get what's left)
+	for (uint32_t begin = 0; begin < order.size(); ) {
+		//[begin,end) have the same priority:
+		uint32_t end = begin + 1;
+		uint32_t slots = requests[order[begin]].sprite->get_sprite_count();
+		while (end < order.size() && requests[order[end]].priority == requests[order[begin]].priority) {
+			slots += requests[order[end]].sprite->get_sprite_count();
+			end += 1;
+		}
+		uint32_t const level = end - begin;
+
+		if (slots_used + slots <= SlotCount || crowded) {
+			//everything fits (or this is below the crowded level, so just fill in gaps):
+			for (uint32_t i = begin; i < end; ++i) {
+				if (!place(requests[order[i]])) dropped += 1;
+			}
+		} else {
+			//not enough room -- start where last frame's turn-taking left off:
+			crowded = true;
+			uint32_t start = rotation % level;
+			uint32_t placed = 0;
+			for (uint32_t i = 0; i < level; ++i) {
+				if (place(requests[order[begin + (start + i) % level]])) placed += 1;
+				else dropped += 1;
+			}
+			rotation = start + placed;
+		}
+
+		begin = end;
+	}
+
+	//hide unused slots:
+	for (uint32_t s = slots_used; s < SlotCount; ++s) {
+		ppu.sprites[s].y = 240;
+	}
+
+	return dropped;
+}
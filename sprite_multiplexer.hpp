@@ -0,0 +1,41 @@
+#pragma once
+
+#include "PPU466.hpp"
+#include "Sprites.hpp"
+
+#include <vector>
+#include <stdint.h>
+
+//SpriteMultiplexer packs any number of (multi-tile) Sprites into the PPU's hardware sprite slots.
+//
+//Each frame: clear(), add() everything that should be on screen, then pack().
+// Higher-priority sprites get slots first. If a priority level doesn't fit in the slots
+// that are left, its sprites take turns: each frame starts with the ones left out last
+// time, so every sprite shows up some of the time (flickers) instead of some never showing.
+struct SpriteMultiplexer {
+	void clear();
+
+	//draw 'sprite' (frame 'frame', maybe mirrored) with its origin at (x,y) this frame:
+	void add(Sprite const *sprite, int32_t x, int32_t y, uint32_t frame = 0, bool flip_x = false, int32_t priority = 0);
+
+	//write this frame's sprites to ppu->sprites (moving unused slots off-screen);
+	// returns the number of sprites that didn't fit:
+	uint32_t pack(PPU466 *ppu);
+
+	//stats from the most recent pack():
+	uint32_t requested = 0; //sprites added
+	uint32_t dropped = 0; //sprites that didn't fit
+	uint32_t slots_used = 0; //hardware slots filled
+
+private:
+	struct Request {
+		Sprite const *sprite;
+		int32_t x, y;
+		uint32_t frame;
+		bool flip_x;
+		int32_t priority;
+	};
+	std::vector< Request > requests;
+	std::vector< uint32_t > order; //requests sorted by priority (scratch space for pack())
+	uint32_t rotation = 0; //where the next crowded priority level starts taking turns
+};
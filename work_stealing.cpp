@@ -0,0 +1,89 @@
+#include "work_stealing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+//the part of [0,count) a worker has yet to start:
+// (the owner takes from the front, thieves take from the back)
+struct alignas(64) Slice {
+	std::mutex mutex;
+	uint32_t begin = 0;
+	uint32_t end = 0;
+};
+
+} //namespace
+
+uint64_t run_work_stealing(uint32_t count, uint32_t workers, std::function< void(uint32_t, uint32_t) > const &fn) {
+	if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+	workers = std::max(1u, std::min(workers, count));
+	if (count == 0) return 0;
+
+	std::unique_ptr< Slice[] > slices(new Slice[workers]);
+	for (uint32_t w = 0; w < workers; ++w) {
+		slices[w].begin = uint32_t(uint64_t(count) * w / workers);
+		slices[w].end = uint32_t(uint64_t(count) * (w + 1) / workers);
+	}
+
+	std::atomic< uint64_t > steals{0};
+
+	auto work = [&](uint32_t self) {
+		Slice &mine = slices[self];
+		while (true) {
+			//next item of my own slice:
+			uint32_t index = 0;
+			bool have = false;
+			{
+				std::unique_lock< std::mutex > lock(mine.mutex);
+				if (mine.begin < mine.end) {
+					index = mine.begin;
+					mine.begin += 1;
+					have = true;
+				}
+			}
+			if (have) {
+				fn(index, self);
+				continue;
+			}
+
+			//out of work -- steal the back half of someone else's slice:
+			bool stole = false;
+			for (uint32_t i = 1; i < workers && !stole; ++i) {
+				Slice &victim = slices[(self + i) % workers];
+				uint32_t begin, end;
+				{
+					std::unique_lock< std::mutex > lock(victim.mutex);
+					if (victim.begin >= victim.end) continue;
+					end = victim.end;
+					begin = victim.begin + (victim.end - victim.begin) / 2;
+					victim.end = begin;
+				}
+				{
+					std::unique_lock< std::mutex > lock(mine.mutex);
+					mine.begin = begin;
+					mine.end = end;
+				}
+				steals.fetch_add(1, std::memory_order_relaxed);
+				stole = true;
+			}
+			//(nothing is ever added, so once every slice is empty we're done)
+			if (!stole) break;
+		}
+	};
+
+	std::vector< std::thread > threads;
+	for (uint32_t w = 1; w < workers; ++w) {
+		threads.emplace_back(work, w);
+	}
+	work(0);
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	return steals.load();
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+
+//Run fn(index, worker) once for every index in [0, count), spread over 'workers' threads
+// (0 = one per hardware thread). Returns once every call has finished.
+//
+//Each worker starts with an equal slice of the indices and works through it in order; a worker
+// that runs out steals the back half of another worker's remaining slice. So items of very
+// different cost (e.g., games that end early or run long) still keep every core busy.
+//
+//'fn' is called concurrently from different threads (never twice for the same index), and
+// should not throw. Returns the number of steals (a measure of how uneven the work was).
+uint64_t run_work_stealing(uint32_t count, uint32_t workers, std::function< void(uint32_t index, uint32_t worker) > const &fn);
@@ -0,0 +1,149 @@
+#include "world_map.hpp"
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <stdint.h>
+
+void WorldMap::build(uint32_t width_, uint32_t height_, std::vector< uint16_t > const &tiles, std::vector< uint8_t > const &solid_) {
+	if (width_ == 0 || height_ == 0 || width_ > MaxSize || height_ > MaxSize) {
+		throw std::runtime_error("World size " + std::to_string(width_) + "x" + std::to_string(height_) + " should be between 1x1 and " + std::to_string(MaxSize) + "x" + std::to_string(MaxSize) + ".");
+	}
+	assert(tiles.size() == size_t(width_) * height_);
+	assert(solid_.size() == size_t(width_) * height_);
+
+	width = width_;
+	height = height_;
+	chunks_x = (width + ChunkSize - 1) / ChunkSize;
+	chunks_y = (height + ChunkSize - 1) / ChunkSize;
+	chunk_index.clear();
+	chunks.clear();
+
+	std::map< Chunk, uint32_t > seen; //unique chunk -> index in 'chunks'
+	for (uint32_t cy = 0; cy < chunks_y; ++cy) {
+		for (uint32_t cx = 0; cx < chunks_x; ++cx) {
+			//(the parts of edge chunks outside the map stay empty)
+			Chunk chunk;
+			for (uint32_t y = 0; y < ChunkSize && cy * ChunkSize + y < height; ++y) {
+				for (uint32_t x = 0; x < ChunkSize && cx * ChunkSize + x < width; ++x) {
+					size_t i = (cx * ChunkSize + x) + size_t(width) * (cy * ChunkSize + y);
+					chunk.tiles[x + ChunkSize * y] = tiles[i];
+					if (solid_[i]) chunk.solid[y] |= uint16_t(1u << x);
+				}
+			}
+			auto found = seen.emplace(chunk, uint32_t(chunks.size()));
+			if (found.second) chunks.emplace_back(chunk);
+			chunk_index.emplace_back(found.first->second);
+		}
+	}
+}
+
+bool WorldMap::any_solid(int32_t x0, int32_t y0, int32_t x1, int32_t y1) const {
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, int32_t(width) - 1);
+	y1 = std::min(y1, int32_t(height) - 1);
+	if (x0 > x1 || y0 > y1) return false;
+
+	int32_t const CS = int32_t(ChunkSize);
+	for (int32_t y = y0; y <= y1; ++y) {
+		for (int32_t cx = x0 / CS; cx <= x1 / CS; ++cx) {
+			//bits of [x0,x1] that fall in this chunk:
+			int32_t lo = std::max(x0 - cx * CS, 0);
+			int32_t hi = std::min(x1 - cx * CS, CS - 1);
+			uint32_t mask = ((2u << hi) - 1u) & ~((1u << lo) - 1u);
+			Chunk const &chunk = chunks[chunk_index[uint32_t(cx) + chunks_x * uint32_t(y / CS)]];
+			if (chunk.solid[uint32_t(y % CS)] & mask) return true;
+		}
+	}
+	return false;
+}
+
+void read_world_map(std::istream &from, WorldMap *world_) {
+	assert(world_);
+	WorldMap &world = *world_;
+
+	std::vector< WorldMapHeader > headers;
+	read_chunk(from, "WRLD", &headers);
+	if (headers.size() != 1) throw std::runtime_error("Expected one world header, found " + std::to_string(headers.size()) + ".");
+	WorldMapHeader const &header = headers[0];
+	if (header.chunk_size != WorldMap::ChunkSize) throw std::runtime_error("World was built with " + std::to_string(header.chunk_size) + "-tile chunks, not " + std::to_string(WorldMap::ChunkSize) + ".");
+	if (header.width == 0 || header.height == 0 || header.width > WorldMap::MaxSize || header.height > WorldMap::MaxSize) throw std::runtime_error("World has an invalid size.");
+
+	world.width = header.width;
+	world.height = header.height;
+	world.chunks_x = (world.width + WorldMap::ChunkSize - 1) / WorldMap::ChunkSize;
+	world.chunks_y = (world.height + WorldMap::ChunkSize - 1) / WorldMap::ChunkSize;
+	read_chunk(from, "WIDX", &world.chunk_index);
+	read_chunk(from, "WCHK", &world.chunks);
+
+	if (world.chunk_index.size() != size_t(world.chunks_x) * world.chunks_y) throw std::runtime_error("World chunk index is the wrong size.");
+	for (uint32_t index : world.chunk_index) {
+		if (index >= world.chunks.size()) throw std::runtime_error("World chunk index is out of range.");
+	}
+}
+
+void write_world_map(WorldMap const &world, std::ostream *to) {
+	assert(to);
+	WorldMapHeader header;
+	header.width = world.width;
+	header.height = world.height;
+	write_chunk("WRLD", std::vector< WorldMapHeader >{ header }, to);
+	write_chunk("WIDX", world.chunk_index, to);
+	write_chunk("WCHK", world.chunks, to);
+}
+
+uint32_t BackgroundStreamer::stream(WorldMap const &world, glm::ivec2 const &view, BackgroundLayer *layer) {
+	assert(layer);
+
+	//move the window only as far as needed to hold the view:
+	// (or, when starting out, put the view in its middle)
+	glm::ivec2 want;
+	if (loaded) {
+		want.x = std::clamp(window.x, view.x + ViewWidth - Width, view.x);
+		want.y = std::clamp(window.y, view.y + ViewHeight - Height, view.y);
+	} else {
+		want = view - glm::ivec2(Width - ViewWidth, Height - ViewHeight) / 2;
+	}
+
+	uint32_t written = 0;
+	auto wrap = [](int32_t v, int32_t n) { return ((v % n) + n) % n; };
+	auto write = [&](int32_t x, int32_t y) {
+		layer->set_base(wrap(x, Width), wrap(y, Height), world.tile(x, y));
+		written += 1;
+	};
+
+	if (!loaded || std::abs(want.x - window.x) >= Width || std::abs(want.y - window.y) >= Height) {
+		//nothing in the ring is still useful:
+		for (int32_t y = want.y; y < want.y + Height; ++y) {
+			for (int32_t x = want.x; x < want.x + Width; ++x) {
+				write(x, y);
+			}
+		}
+	} else {
+		//columns newly in the window (over the rows it used to cover)...
+		int32_t x_begin = (want.x > window.x ? window.x + Width : want.x);
+		int32_t x_end = (want.x > window.x ? want.x + Width : window.x);
+		for (int32_t x = x_begin; x < x_end; ++x) {
+			for (int32_t y = window.y; y < window.y + Height; ++y) {
+				write(x, y);
+			}
+		}
+		//...then rows newly in the window (over the columns it covers now):
+		int32_t y_begin = (want.y > window.y ? window.y + Height : want.y);
+		int32_t y_end = (want.y > window.y ? want.y + Height : window.y);
+		for (int32_t y = y_begin; y < y_end; ++y) {
+			for (int32_t x = want.x; x < want.x + Width; ++x) {
+				write(x, y);
+			}
+		}
+	}
+
+	window = want;
+	loaded = true;
+	return written;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "PPU466.hpp"
+#include "background_layer.hpp"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <iosfwd>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * WorldMap is a tile map of any size (up to MaxSize tiles on a side), for levels bigger
+ * than PPU466's 64x60 background.
+ *
+ * The map is cut into ChunkSize x ChunkSize-tile chunks, and identical chunks are stored
+ * once -- so open sky, solid ground, and other repeated pieces cost only a four-byte index
+ * after their first use. Each chunk holds the background entry of every tile and which tiles
+ * are solid, so collision tests read the map directly.
+ *
+ * Stored (after a level's "LEVL" chunk -- see level.hpp) as:
+ *  'WRLD' -- one WorldMapHeader
+ *  'WIDX' -- uint32_t index into the chunk list for each chunk of the map, row-major from the bottom left
+ *  'WCHK' -- the unique WorldMap::Chunk's
+ */
+struct WorldMap {
+	enum : uint32_t {
+		ChunkSize = 16, //tiles on a side
+		MaxSize = 4096 //tiles on a side (so pixel positions fit in int16_t, as LevelSpawn stores them)
+	};
+
+	struct Chunk {
+		//tile (x,y) of the chunk, (0,0) at the bottom left:
+		std::array< uint16_t, ChunkSize * ChunkSize > tiles{}; //PPU466::background entries, at [x + ChunkSize * y]
+		std::array< uint16_t, ChunkSize > solid{}; //bit x of solid[y] is set if the tile is solid
+		auto operator<=>(Chunk const &) const = default;
+	};
+	static_assert(ChunkSize <= 16, "a chunk row of solid bits fits in a uint16_t");
+
+	uint32_t width = 0, height = 0; //in tiles
+	uint32_t chunks_x = 0, chunks_y = 0; //(width and height in whole chunks, rounded up)
+	std::vector< uint32_t > chunk_index; //chunks_x * chunks_y entries, indexing 'chunks'
+	std::vector< Chunk > chunks; //unique chunks
+
+	//build from one entry per tile (row-major from the bottom left), sharing repeated chunks:
+	// (throws if width or height is zero or more than MaxSize)
+	void build(uint32_t width, uint32_t height, std::vector< uint16_t > const &tiles, std::vector< uint8_t > const &solid);
+
+	bool inside(int32_t x, int32_t y) const {
+		return x >= 0 && x < int32_t(width) && y >= 0 && y < int32_t(height);
+	}
+	//(tiles outside the map are entry zero and not solid)
+	uint16_t tile(int32_t x, int32_t y) const {
+		if (!inside(x, y)) return 0;
+		return chunk_at(x, y).tiles[uint32_t(x) % ChunkSize + ChunkSize * (uint32_t(y) % ChunkSize)];
+	}
+	bool solid(int32_t x, int32_t y) const {
+		if (!inside(x, y)) return false;
+		return (chunk_at(x, y).solid[uint32_t(y) % ChunkSize] >> (uint32_t(x) % ChunkSize)) & 1;
+	}
+	//is any tile in [x0,x1] x [y0,y1] (inclusive) solid?
+	// (one mask test per chunk per tile row the box covers)
+	bool any_solid(int32_t x0, int32_t y0, int32_t x1, int32_t y1) const;
+
+	//size of the map in memory (index and unique chunks):
+	size_t bytes() const { return chunk_index.size() * sizeof(uint32_t) + chunks.size() * sizeof(Chunk); }
+
+private:
+	Chunk const &chunk_at(int32_t x, int32_t y) const {
+		return chunks[chunk_index[uint32_t(x) / ChunkSize + chunks_x * (uint32_t(y) / ChunkSize)]];
+	}
+};
+
+struct WorldMapHeader {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t chunk_size = WorldMap::ChunkSize; //(checked on load)
+	uint32_t unused = 0;
+};
+static_assert(sizeof(WorldMapHeader) == 16, "WorldMapHeader is packed");
+
+//read / write the chunks listed above (read throws if they are missing or inconsistent):
+void read_world_map(std::istream &from, WorldMap *world);
+void write_world_map(WorldMap const &world, std::ostream *to);
+
+
+//BackgroundStreamer keeps the background ring (through a BackgroundLayer) holding the part of a
+// WorldMap around the camera:
+//
+//World tile (x,y) goes in ring entry (x mod Width, y mod Height), so with ppu.background_position
+// set to minus the camera position the ring scrolls along with the world. The ring holds a
+// Width x Height window of the world that only moves when the view would leave it, and moving it
+// writes just the columns and rows it newly covers -- a column or row per tile the camera crosses,
+// however big the world is.
+struct BackgroundStreamer {
+	enum : int32_t {
+		Width = int32_t(BackgroundLayer::Width),
+		Height = int32_t(BackgroundLayer::Height),
+		//tiles a screen can touch (one more than fit, as the view is rarely tile-aligned):
+		ViewWidth = int32_t(PPU466::ScreenWidth / 8) + 1,
+		ViewHeight = int32_t(PPU466::ScreenHeight / 8) + 1,
+	};
+
+	//forget what the ring holds (so the next stream() fills all of it, e.g., for a new level):
+	void reset() { loaded = false; }
+
+	//make sure the ring holds the view whose bottom-left tile is 'view':
+	// returns the number of entries written
+	uint32_t stream(WorldMap const &world, glm::ivec2 const &view, BackgroundLayer *layer);
+
+	glm::ivec2 window = glm::ivec2(0); //bottom-left world tile of the window the ring holds
+	bool loaded = false; //(false until the first stream())
+};